@@ -35,6 +35,8 @@ namespace spt::application::ux {
     using spt::domain::investments::Ticker;
     using spt::domain::investments::Money;
     using spt::domain::investments::Price;
+    using spt::infrastructure::services::FetchBatchOptions;
+    using spt::infrastructure::services::FetchOutcome;
     using spt::infrastructure::services::YahooPriceFetcher;
     
     enum class MenuId {
@@ -66,6 +68,7 @@ namespace spt::application::ux {
                   _holdingsGrid(nullptr)
             {
                 srand(static_cast<unsigned int>(time(nullptr)));
+                _priceFetcher.setBatching(FetchBatchOptions { true, 20, 50 });
                 
                 createMenuBar();
                 createToolBar();
@@ -257,8 +260,18 @@ namespace spt::application::ux {
                 SetStatusText("Fetching price data...");
                 
                 try {
-                    _priceFetcher.fetch(_portfolio.value());
-                    SetStatusText("Price data loaded.");
+                    auto report { _priceFetcher.fetchAll(_portfolio.value()) };
+                    if (report.failed == 0) {
+                        SetStatusText("Price data loaded.");
+                    } else {
+                        string failed { };
+                        for (const auto& result : report.results) {
+                            if (result.outcome == FetchOutcome::Error) {
+                                failed += (failed.empty() ? "" : ", ") + result.ticker.symbol();
+                            }
+                        }
+                        SetStatusText(wxString::Format("Price data loaded; failed for %s", failed));
+                    }
                 } catch (const exception& ex) {
                     SetStatusText(wxString::Format("Error fetching prices: %s", ex.what()));
                 }
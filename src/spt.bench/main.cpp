@@ -0,0 +1,735 @@
+import std;
+import spt.domain;
+import spt.infrastructure;
+
+// defined in metrics.cpp
+namespace spt::bench {
+    std::size_t allocationCount();
+    std::size_t allocatedBytes();
+    std::size_t resetHeapPeak();
+    std::size_t heapPeak();
+    std::size_t peakResidentBytes();
+}
+
+namespace spt::bench {
+    using std::chrono::duration;
+    using std::chrono::milliseconds;
+    using std::chrono::steady_clock;
+    using std::exception;
+    using std::format;
+    using std::function;
+    using std::ifstream;
+    using std::ios;
+    using std::istreambuf_iterator;
+    using std::ldexp;
+    using std::make_shared;
+    using std::max;
+    using std::milli;
+    using std::move;
+    using std::mt19937_64;
+    using std::ofstream;
+    using std::println;
+    using std::runtime_error;
+    using std::size_t;
+    using std::set;
+    using std::sort;
+    using std::stod;
+    using std::stoul;
+    using std::string;
+    using std::string_view;
+    using std::uniform_int_distribution;
+    using std::uniform_real_distribution;
+    using std::vector;
+    using std::filesystem::create_directories;
+    using std::filesystem::directory_iterator;
+    using std::filesystem::path;
+    using spt::domain::investments::Company;
+    using spt::domain::investments::Portfolio;
+    using spt::domain::investments::Ticker;
+    using spt::infrastructure::net::HttpBufferPool;
+    using spt::infrastructure::net::HttpClient;
+    using spt::infrastructure::net::HttpMethod;
+    using spt::infrastructure::net::HttpMetrics;
+    using spt::infrastructure::net::HttpPhase;
+    using spt::infrastructure::net::HttpRateLimiter;
+    using spt::infrastructure::net::HttpRecording;
+    using spt::infrastructure::net::HttpReplayOptions;
+    using spt::infrastructure::net::HttpReplayServer;
+    using spt::infrastructure::net::HttpRequest;
+    using spt::infrastructure::net::HttpVersion;
+    using spt::infrastructure::services::FetchBatchOptions;
+    using spt::infrastructure::services::YahooCompanySearch;
+    using spt::infrastructure::services::YahooPriceFetcher;
+    using spt::infrastructure::text::JsonDocument;
+    using spt::infrastructure::text::JsonEngine;
+    using spt::infrastructure::text::JsonParser;
+    using spt::infrastructure::text::JsonStreamParser;
+    using spt::infrastructure::text::JsonTape;
+    using spt::infrastructure::text::JsonValue;
+    using spt::infrastructure::text::JsonValueBuilder;
+    using spt::infrastructure::text::JsonWriter;
+
+    struct Payload {
+        string name;
+        string json;
+    };
+
+    // 'run' is what gets timed; 'read' turns the engine's result into a JsonValue so engines
+    // can be compared before they are timed.
+    struct Engine {
+        string name;
+        function<void(const string&)> run;
+        function<JsonValue(const string&)> read;
+    };
+
+    // Builds a chart response shaped like Yahoo's v8 chart endpoint with 'points' samples.
+    string chartPayload(size_t points) {
+        mt19937_64 random { 42 };
+        uniform_real_distribution<double> noise { -0.5, 0.5 };
+
+        JsonWriter writer { };
+        writer.onStartObject();
+        writer.onKey("chart");
+        writer.onStartObject();
+        writer.onKey("result");
+        writer.onStartArray();
+        writer.onStartObject();
+        writer.onKey("meta");
+        writer.onStartObject();
+        writer.onKey("currency");
+        writer.onString("USD");
+        writer.onKey("symbol");
+        writer.onString("MSFT");
+        writer.onKey("exchangeName");
+        writer.onString("NMS");
+        writer.onKey("regularMarketPrice");
+        writer.onNumber(421.53);
+        writer.onEndObject();
+
+        writer.onKey("timestamp");
+        writer.onStartArray();
+        for (size_t i = 0; i < points; ++i) {
+            writer.onNumber(static_cast<double>(1700000000 + i * 60));
+        }
+        writer.onEndArray();
+
+        writer.onKey("indicators");
+        writer.onStartObject();
+        writer.onKey("quote");
+        writer.onStartArray();
+        writer.onStartObject();
+        for (string_view series : { "open", "high", "low", "close", "volume" }) {
+            double price { 420.0 };
+            writer.onKey(series);
+            writer.onStartArray();
+            for (size_t i = 0; i < points; ++i) {
+                price += noise(random);
+                if (i % 97 == 13) {
+                    writer.onNull();
+                } else {
+                    writer.onNumber(series == "volume" ? static_cast<double>(static_cast<long long>(price * 1000)) : price);
+                }
+            }
+            writer.onEndArray();
+        }
+        writer.onEndObject();
+        writer.onEndArray();
+        writer.onEndObject();
+        writer.onEndObject();
+        writer.onEndArray();
+        writer.onKey("error");
+        writer.onNull();
+        writer.onEndObject();
+        writer.onEndObject();
+        return string { writer.view() };
+    }
+
+    // Many small objects with string members, like the search endpoint's quotes and news.
+    string searchPayload(size_t quotes) {
+        JsonWriter writer { };
+        writer.onStartObject();
+        writer.onKey("quotes");
+        writer.onStartArray();
+        for (size_t i = 0; i < quotes; ++i) {
+            writer.onStartObject();
+            writer.onKey("symbol");
+            writer.onString(format("SYM{0}", i));
+            writer.onKey("shortname");
+            writer.onString("Société Générale \"SG\" S.A.");
+            writer.onKey("quoteType");
+            writer.onString("EQUITY");
+            writer.onKey("exchDisp");
+            writer.onString("Paris");
+            writer.onKey("score");
+            writer.onNumber(20000.0 + static_cast<double>(i));
+            writer.onKey("isYahooFinance");
+            writer.onBoolean(true);
+            writer.onEndObject();
+        }
+        writer.onEndArray();
+        writer.onEndObject();
+        return string { writer.view() };
+    }
+
+    // Stress documents for the paths the recorded responses barely touch.
+    string nestedPayload(size_t depth) {
+        return string(depth, '[') + "1" + string(depth, ']');
+    }
+
+    string numbersPayload(size_t count) {
+        mt19937_64 random { 7 };
+        uniform_real_distribution<double> mantissa { -1.0, 1.0 };
+        uniform_int_distribution<int> exponent { -300, 300 };
+
+        JsonWriter writer { };
+        writer.onStartArray();
+        for (size_t i = 0; i < count; ++i) {
+            writer.onNumber(ldexp(mantissa(random), exponent(random)));
+        }
+        writer.onEndArray();
+        return string { writer.view() };
+    }
+
+    string escapedStringsPayload(size_t count) {
+        JsonWriter writer { };
+        writer.onStartArray();
+        for (size_t i = 0; i < count; ++i) {
+            writer.onString("line one\nline \"two\"\t\\ tab");
+        }
+        writer.onEndArray();
+        return string { writer.view() };
+    }
+
+    string wideObjectPayload(size_t members) {
+        JsonWriter writer { };
+        writer.onStartObject();
+        for (size_t i = 0; i < members; ++i) {
+            writer.onKey(format("member{0:06}", (i * 7919) % members));
+            writer.onNumber(static_cast<double>(i));
+        }
+        writer.onEndObject();
+        return string { writer.view() };
+    }
+
+    vector<Payload> syntheticPayloads() {
+        return vector<Payload> {
+            Payload { "synthetic chart 1d/1m", chartPayload(390) },
+            Payload { "synthetic chart 5d/1m", chartPayload(1950) },
+            Payload { "synthetic chart 1y/1d", chartPayload(252) },
+            Payload { "synthetic search", searchPayload(10) },
+            Payload { "stress quotes", searchPayload(10000) },
+            Payload { "stress nesting", nestedPayload(512) },
+            Payload { "stress numbers", numbersPayload(100000) },
+            Payload { "stress escapes", escapedStringsPayload(20000) },
+            Payload { "stress wide object", wideObjectPayload(20000) }
+        };
+    }
+
+    string readFile(const path& file) {
+        ifstream stream { file, ios::binary };
+        return string { istreambuf_iterator<char> { stream }, istreambuf_iterator<char> { } };
+    }
+
+    // the exchanges --record keeps for --replay, not a payload
+    constexpr string_view recordingName { "exchanges.json" };
+
+    vector<Payload> loadCorpus(const path& directory) {
+        vector<Payload> payloads { };
+        for (const auto& entry : directory_iterator { directory }) {
+            if (entry.is_regular_file() && entry.path().extension() == ".json" && entry.path().filename() != recordingName) {
+                payloads.push_back(Payload { entry.path().stem().string(), readFile(entry.path()) });
+            }
+        }
+        sort(payloads.begin(), payloads.end(), [](const Payload& left, const Payload& right) {
+            return left.name < right.name;
+        });
+        return payloads;
+    }
+
+    // Downloads the responses the application actually parses so runs can be repeated offline,
+    // keeping every exchange with its headers and timing for --replay as well.
+    void recordCorpus(const path& directory, const vector<string>& symbols) {
+        struct Range {
+            string_view range;
+            string_view interval;
+        };
+        constexpr Range ranges[] { { "1d", "1m" }, { "5d", "1m" }, { "1y", "1d" } };
+
+        create_directories(directory);
+        auto recording { make_shared<HttpRecording>() };
+        HttpClient client { };
+        client.recording(recording);
+        auto save = [&client, &directory](string_view url, string name) {
+            HttpRequest request { url, HttpMethod::GET };
+            request.setHeader("Accept", "application/json");
+            request.setHeader("User-Agent", "Blendwerk SPT/1.0");
+            auto response { client.send(request) };
+            if (!response.isSuccess()) {
+                println("skipped {0}: status {1}", name, response.status());
+                return;
+            }
+            ofstream { directory / (name + ".json"), ios::binary } << response.body();
+            println("recorded {0} ({1} bytes)", name, response.body().size());
+        };
+
+        for (const auto& symbol : symbols) {
+            for (const auto& [range, interval] : ranges) {
+                save(
+                    format("https://query1.finance.yahoo.com/v8/finance/chart/{0}?range={1}&interval={2}", symbol, range, interval),
+                    format("chart-{0}-{1}-{2}", symbol, range, interval)
+                );
+            }
+            save(format("https://query1.finance.yahoo.com/v1/finance/search?q={0}", symbol), format("search-{0}", symbol));
+        }
+
+        // the spark and quote requests of a batched portfolio fetch, for --replay to repeat
+        Portfolio portfolio { };
+        for (const auto& symbol : symbols) {
+            portfolio.track(Ticker { symbol });
+        }
+        YahooPriceFetcher fetcher { client };
+        fetcher.setBatching(FetchBatchOptions { true, 20, 50 });
+        try {
+            fetcher.fetch(portfolio);
+        } catch (const exception& e) {
+            println("batched fetch failed: {0}", e.what());
+        }
+        recording->save(directory / recordingName);
+        println("recorded {0} exchanges", recording->size());
+    }
+
+    // p50 and p99 of each request phase per endpoint, in milliseconds.
+    void printMetrics(const HttpMetrics& metrics) {
+        struct Column {
+            string_view name;
+            HttpPhase phase;
+        };
+        constexpr Column columns[] {
+            { "dns", HttpPhase::NameLookup },
+            { "connect", HttpPhase::Connect },
+            { "tls", HttpPhase::Tls },
+            { "setup", HttpPhase::PreTransfer },
+            { "server", HttpPhase::Server },
+            { "transfer", HttpPhase::Transfer },
+            { "total", HttpPhase::Total }
+        };
+
+        string header { format("{0:<48} {1:>8}", "endpoint (p50/p99 ms)", "requests") };
+        for (const auto& column : columns) {
+            header += format(" {0:>15}", column.name);
+        }
+        println("{0}", header);
+        for (const auto& endpoint : metrics.endpoints()) {
+            const auto& histograms { metrics.endpoint(endpoint) };
+            string line { format("{0:<48} {1:>8}", endpoint, histograms.bytes().count()) };
+            for (const auto& column : columns) {
+                const auto& phase { histograms.phase(column.phase) };
+                line += format(" {0:>15}", format("{0:.1f}/{1:.1f}", phase.percentile(50.0) / 1000.0, phase.percentile(99.0) / 1000.0));
+            }
+            println("{0}", line);
+        }
+    }
+
+    // Runs the price fetcher and the company search for every symbol in a recording made by
+    // --record, 'rounds' times over, then fetches them all as one portfolio, through the pipeline
+    // and batched, against a local server replaying it under 'options'. The
+    // request timings are written to 'metricsFile' unless it is empty.
+    void benchmarkReplay(const path& directory, HttpReplayOptions options, size_t rounds, const path& metricsFile) {
+        auto recording { HttpRecording::load(directory / recordingName) };
+        set<string> symbols { };
+        for (const auto& exchange : recording->exchanges()) {
+            constexpr string_view chart { "/v8/finance/chart/" };
+            size_t start { exchange.url.find(chart) };
+            if (start != string::npos) {
+                start += chart.size();
+                symbols.insert(exchange.url.substr(start, exchange.url.find('?', start) - start));
+            }
+        }
+
+        HttpReplayServer server { *recording, options };
+        HttpClient client { };
+        client.route("https://query1.finance.yahoo.com", server.origin());
+        // paces nothing, but retries the injected errors like the shared client would
+        client.rateLimiter(make_shared<HttpRateLimiter>(1000.0, 1000.0));
+        client.metrics(make_shared<HttpMetrics>());
+        YahooPriceFetcher fetcher { client };
+        YahooCompanySearch search { client };
+
+        size_t fetches { 0 };
+        size_t failed { 0 };
+        vector<double> latencies { };
+        auto run = [&fetches, &failed, &latencies](auto action) {
+            auto start { steady_clock::now() };
+            try {
+                action();
+            } catch (const exception&) {
+                ++failed;
+            }
+            latencies.push_back(duration<double, milli> { steady_clock::now() - start }.count());
+            ++fetches;
+        };
+
+        auto start { steady_clock::now() };
+        for (size_t round = 0; round < rounds; ++round) {
+            for (const auto& symbol : symbols) {
+                run([&fetcher, &symbol] {
+                    Company company { Ticker { symbol } };
+                    fetcher.fetch(company);
+                });
+                run([&search, &symbol] {
+                    search.search(symbol);
+                });
+            }
+        }
+        double seconds { duration<double> { steady_clock::now() - start }.count() };
+
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double share) {
+            return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(share * static_cast<double>(latencies.size() - 1))];
+        };
+        auto served { server.stats() };
+        auto retried { client.rateLimiter()->stats() };
+        println("{0} fetches of {1} symbols in {2:.2f} s, {3} failed", fetches, symbols.size(), seconds, failed);
+        println("latency: p50 {0:.1f} ms, p90 {1:.1f} ms, p99 {2:.1f} ms, max {3:.1f} ms",
+            percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+        println("server: {0} requests, {1} served, {2} injected errors, {3} unmatched",
+            served.requests, served.served, served.injectedErrors, served.unmatched);
+        println("client: {0} retries, {1} denied by the budget", retried.retries, retried.retriesDenied);
+
+        Portfolio portfolio { };
+        for (const auto& symbol : symbols) {
+            portfolio.track(Ticker { symbol });
+        }
+        auto report { fetcher.fetchAll(portfolio) };
+        auto pipeline { fetcher.getPipelineStats() };
+        println("portfolio of {0} through the pipeline in {1:.1f} ms, p50 {2:.1f} ms, p99 {3:.1f} ms; {4} updated, {5} skipped, {6} failed",
+            pipeline.companies, pipeline.elapsed.count() / 1000.0, pipeline.p50.count() / 1000.0, pipeline.p99.count() / 1000.0,
+            report.succeeded, report.skipped, report.failed);
+        println("busy: fetch {0:.1f} ms, parse {1:.1f} ms, apply {2:.1f} ms; stalls: fetch {3}, parse {4}",
+            pipeline.fetch.busy.count() / 1000.0, pipeline.parse.busy.count() / 1000.0, pipeline.apply.busy.count() / 1000.0,
+            pipeline.fetch.stalls, pipeline.parse.stalls);
+
+        Portfolio batched { };
+        for (const auto& symbol : symbols) {
+            batched.track(Ticker { symbol });
+        }
+        fetcher.setBatching(FetchBatchOptions { true, 20, 50 });
+        auto batchReport { fetcher.fetchAll(batched) };
+        auto batch { fetcher.getBatchStats() };
+        println("portfolio of {0} batched in {1:.1f} ms: {2} requests, {3} charted ({7} from their latest price), {4} quoted, {5} fetched one by one, {6} failed",
+            symbols.size(), batchReport.elapsed.count() / 1000.0,
+            batch.requests, batch.charted, batch.quoted, batch.fallbacks, batchReport.failed, batch.deltas);
+        auto delta { fetcher.getDeltaStats() };
+        println("charts: {0} whole ranges, {1} deltas, {2} bytes, {3} saved by the deltas",
+            delta.full, delta.incremental, delta.bytes, delta.bytesSaved);
+
+        printMetrics(*client.metrics());
+        if (!metricsFile.empty()) {
+            client.metrics()->save(metricsFile);
+        }
+    }
+
+    // Fetches the same chart URLs with a fresh client per request, one after another through a
+    // pooled client, and all at once through sendAll, showing what connection reuse, TLS
+    // session resumption and concurrency save.
+    void benchmarkConnectionReuse(const vector<string>& symbols) {
+        vector<HttpRequest> requests { };
+        for (const auto& symbol : symbols) {
+            HttpRequest request {
+                format("https://query1.finance.yahoo.com/v8/finance/chart/{0}?range=1d&interval=1m", symbol),
+                HttpMethod::GET
+            };
+            request.setHeader("User-Agent", "Blendwerk SPT/1.0");
+            requests.push_back(move(request));
+        }
+
+        auto fetchAll = [&requests](auto clientFor) {
+            auto start { steady_clock::now() };
+            for (const auto& request : requests) {
+                HttpClient client { clientFor() };
+                client.send(request);
+            }
+            return duration<double> { steady_clock::now() - start }.count();
+        };
+
+        double fresh { fetchAll([] {
+            return HttpClient { };
+        }) };
+
+        HttpClient pooled { };
+        pooled.metrics(make_shared<HttpMetrics>());
+        double reused { fetchAll([&pooled] {
+            return pooled;
+        }) };
+
+        HttpClient async { };
+        auto start { steady_clock::now() };
+        for (auto& response : async.sendAll(requests)) {
+            response.get();
+        }
+        double concurrent { duration<double> { steady_clock::now() - start }.count() };
+
+        auto stats { pooled.stats() };
+        println("{0} requests: fresh clients {1:.2f} s, pooled client {2:.2f} s, sendAll {3:.2f} s",
+            symbols.size(), fresh, reused, concurrent);
+        println("pooled: {0} handles created, {1} reused, {2} connections opened ({4} over TLS), {3} reused",
+            stats.handlesCreated, stats.handlesReused, stats.connectionsOpened, stats.connectionsReused, stats.tlsConnections);
+        println("pooled: {0:.1f} KB on the wire for {1:.1f} KB of JSON ({2})",
+            stats.bytesOnWire / 1024.0, stats.bytesDecoded / 1024.0, HttpClient::encodings());
+        auto buffers { HttpBufferPool::shared()->stats() };
+        println("buffers: {0} bodies, {1} written into a recycled buffer without allocating",
+            buffers.acquired, buffers.reused);
+        printMetrics(*pooled.metrics());
+    }
+
+    // Refreshes 'count' symbols from a local HTTP/2 stand-in (any server that answers 'url',
+    // e.g. nghttpd serving a recorded corpus) over HTTP/1.1 connections and multiplexed over
+    // HTTP/2, all requests in flight at once.
+    void benchmarkMultiplexing(const string& url, size_t count) {
+        vector<HttpRequest> requests { };
+        char separator { url.find('?') == string::npos ? '?' : '&' };
+        for (size_t i = 0; i < count; ++i) {
+            requests.emplace_back(format("{0}{1}symbol=SYM{2}", url, separator, i), HttpMethod::GET);
+        }
+
+        auto refresh = [&requests](string_view label, HttpVersion version) {
+            HttpClient client { };
+            client.httpVersion(version);
+            auto start { steady_clock::now() };
+            size_t failed { 0 };
+            for (auto& response : client.sendAll(requests)) {
+                try {
+                    if (!response.get().isSuccess()) {
+                        ++failed;
+                    }
+                } catch (const exception&) {
+                    ++failed;
+                }
+            }
+            double seconds { duration<double> { steady_clock::now() - start }.count() };
+            auto stats { client.stats() };
+            println("{0:<10} {1:>8.2f} s {2:>6} failed {3:>4} connections {4:>6} HTTP/2 responses {5:>10.1f} KB on the wire {6:>10.1f} KB decoded",
+                label, seconds, failed, stats.connectionsOpened, stats.http2Responses, stats.bytesOnWire / 1024.0, stats.bytesDecoded / 1024.0);
+        };
+
+        // cleartext stand-ins cannot negotiate HTTP/2, so they are spoken to with prior knowledge
+        HttpVersion http2 { url.starts_with("https://") ? HttpVersion::Http2 : HttpVersion::Http2Only };
+        println("{0} symbols from {1}", count, url);
+        refresh("HTTP/1.1", HttpVersion::Http1);
+        refresh("HTTP/2", http2);
+    }
+
+    JsonValue streamed(const string& json) {
+        JsonValueBuilder builder { };
+        JsonStreamParser parser { builder };
+        parser.feed(json);
+        parser.finish();
+        return builder.result();
+    }
+
+    vector<Engine> engines() {
+        return vector<Engine> {
+            Engine { "classic", [](const string& json) {
+                JsonValue value { JsonParser::parse(json, JsonEngine::Classic) };
+            }, [](const string& json) {
+                return JsonParser::parse(json, JsonEngine::Classic);
+            } },
+            Engine { "structural", [](const string& json) {
+                JsonValue value { JsonParser::parse(json, JsonEngine::Structural) };
+            }, [](const string& json) {
+                return JsonParser::parse(json, JsonEngine::Structural);
+            } },
+            Engine { "stream", [](const string& json) {
+                JsonValue value { streamed(json) };
+            }, streamed },
+            Engine { "tape", [](const string& json) {
+                JsonTape tape { JsonTape::parse(json) };
+            }, [](const string& json) {
+                return JsonTape::parse(json).root().toValue();
+            } },
+            Engine { "document", [](const string& json) {
+                JsonDocument document { json };
+            }, [](const string& json) {
+                return JsonDocument { json }.root().toValue();
+            } }
+        };
+    }
+
+    // Every engine must read 'payload' into the same document as the classic parser, down to
+    // the last digit of every number, or its timings mean nothing. Objects are written with
+    // their members sorted, so equal documents serialize to equal text.
+    void verifyEngines(const Payload& payload, const vector<Engine>& all) {
+        string expected { JsonWriter::serialize(all.front().read(payload.json)) };
+        for (const auto& engine : all) {
+            if (JsonWriter::serialize(engine.read(payload.json)) != expected) {
+                throw runtime_error {
+                    format("{0} reads '{1}' differently from {2}", engine.name, payload.name, all.front().name)
+                };
+            }
+        }
+    }
+
+    template <typename Action>
+    double megabytesPerSecond(size_t bytes, Action action) {
+        // enough repetitions for roughly 64 MB of input, and never fewer than five
+        size_t iterations { max<size_t>(5, (64u << 20) / max<size_t>(bytes, 1)) };
+        auto start { steady_clock::now() };
+        for (size_t i = 0; i < iterations; ++i) {
+            action();
+        }
+        duration<double> elapsed { steady_clock::now() - start };
+        return static_cast<double>(bytes * iterations) / (1024.0 * 1024.0) / elapsed.count();
+    }
+
+    void benchmarkParsers(const vector<Payload>& payloads) {
+        println("{0:<24} {1:<11} {2:>10} {3:>10} {4:>12} {5:>12} {6:>12}",
+            "payload", "engine", "bytes", "MB/s", "allocs/doc", "KB/doc", "peak KB");
+
+        auto all { engines() };
+        for (const auto& payload : payloads) {
+            verifyEngines(payload, all);
+            for (const auto& engine : all) {
+                try {
+                    engine.run(payload.json);   // warm up
+
+                    auto allocations { allocationCount() };
+                    auto bytes { allocatedBytes() };
+                    auto baseline { resetHeapPeak() };
+                    engine.run(payload.json);
+                    allocations = allocationCount() - allocations;
+                    bytes = allocatedBytes() - bytes;
+                    auto peak { heapPeak() - baseline };
+
+                    double speed { megabytesPerSecond(payload.json.size(), [&engine, &payload] {
+                        engine.run(payload.json);
+                    }) };
+
+                    println("{0:<24} {1:<11} {2:>10} {3:>10.1f} {4:>12} {5:>12.1f} {6:>12.1f}",
+                        payload.name, engine.name, payload.json.size(), speed, allocations, bytes / 1024.0, peak / 1024.0);
+                } catch (const exception& ex) {
+                    println("{0:<24} {1:<11} failed: {2}", payload.name, engine.name, ex.what());
+                }
+            }
+        }
+    }
+
+    void benchmarkWriter(const vector<Payload>& payloads) {
+        println("{0:<24} {1:>10} {2:>12}", "payload", "bytes", "write MB/s");
+
+        JsonWriter writer { };
+        for (const auto& payload : payloads) {
+            JsonValue value { JsonParser::parse(payload.json) };
+            size_t written { JsonWriter::serialize(value).size() };
+            double speed { megabytesPerSecond(written, [&writer, &value] {
+                writer.clear();
+                writer.write(value);
+            }) };
+            println("{0:<24} {1:>10} {2:>12.1f}", payload.name, written, speed);
+        }
+    }
+}
+
+// spt_bench [CORPUS_DIR]                    runs every engine over the corpus and synthetic inputs
+// spt_bench --record CORPUS_DIR [SYMBOL...]  downloads chart and search responses into CORPUS_DIR
+// spt_bench --reuse [SYMBOL...]              compares fresh, pooled and concurrent requests to Yahoo
+// spt_bench --http2 URL [COUNT]              refreshes COUNT symbols from a local HTTP/2 stand-in
+// spt_bench --replay CORPUS_DIR [--rounds N] [--latency MS] [--jitter MS] [--errors RATE]
+//           [--bandwidth KBPS] [--recorded-latency] [--metrics FILE]
+//                                            runs the Yahoo services against a recording
+int main(int argc, char* argv[]) {
+    using namespace spt::bench;
+
+    vector<string> arguments { argv + 1, argv + argc };
+    try {
+        if (!arguments.empty() && arguments[0] == "--record") {
+            if (arguments.size() < 2) {
+                println("usage: spt_bench --record CORPUS_DIR [SYMBOL...]");
+                return 1;
+            }
+            vector<string> symbols { arguments.begin() + 2, arguments.end() };
+            if (symbols.empty()) {
+                symbols = { "MSFT", "AAPL" };
+            }
+            recordCorpus(arguments[1], symbols);
+            return 0;
+        }
+
+        if (!arguments.empty() && arguments[0] == "--reuse") {
+            vector<string> symbols { arguments.begin() + 1, arguments.end() };
+            if (symbols.empty()) {
+                symbols = { "MSFT", "AAPL", "GOOG", "AMZN", "NVDA", "META", "TSLA", "JPM" };
+            }
+            benchmarkConnectionReuse(symbols);
+            return 0;
+        }
+
+        if (!arguments.empty() && arguments[0] == "--http2") {
+            if (arguments.size() < 2) {
+                println("usage: spt_bench --http2 URL [COUNT]");
+                return 1;
+            }
+            size_t count { arguments.size() > 2 ? static_cast<size_t>(stoul(arguments[2])) : 500 };
+            benchmarkMultiplexing(arguments[1], count);
+            return 0;
+        }
+
+        if (!arguments.empty() && arguments[0] == "--replay") {
+            if (arguments.size() < 2) {
+                println("usage: spt_bench --replay CORPUS_DIR [--rounds N] [--latency MS] [--jitter MS] [--errors RATE] [--bandwidth KBPS] [--recorded-latency] [--metrics FILE]");
+                return 1;
+            }
+            HttpReplayOptions options { milliseconds { 0 }, milliseconds { 0 }, 0.0, 0, false, 42 };
+            size_t rounds { 10 };
+            path metricsFile { };
+            for (size_t i = 2; i < arguments.size(); ++i) {
+                const string& option { arguments[i] };
+                if (option == "--recorded-latency") {
+                    options.recordedLatency = true;
+                    continue;
+                }
+                if (i + 1 == arguments.size()) {
+                    println("spt_bench: {0} needs a value", option);
+                    return 1;
+                }
+                const string& value { arguments[++i] };
+                if (option == "--rounds") {
+                    rounds = static_cast<size_t>(stoul(value));
+                } else if (option == "--latency") {
+                    options.latency = milliseconds { stoul(value) };
+                } else if (option == "--jitter") {
+                    options.jitter = milliseconds { stoul(value) };
+                } else if (option == "--errors") {
+                    options.errorRate = stod(value);
+                } else if (option == "--bandwidth") {
+                    options.bandwidth = static_cast<size_t>(stoul(value)) * 1024;
+                } else if (option == "--metrics") {
+                    metricsFile = value;
+                } else {
+                    println("spt_bench: unknown option {0}", option);
+                    return 1;
+                }
+            }
+            benchmarkReplay(arguments[1], options, rounds, metricsFile);
+            return 0;
+        }
+
+        vector<Payload> payloads { };
+        if (!arguments.empty()) {
+            payloads = loadCorpus(arguments[0]);
+        }
+        for (auto& payload : syntheticPayloads()) {
+            payloads.push_back(move(payload));
+        }
+
+        benchmarkParsers(payloads);
+        println("");
+        benchmarkWriter(payloads);
+        println("");
+        println("peak RSS: {0:.1f} MB", peakResidentBytes() / (1024.0 * 1024.0));
+    } catch (const exception& ex) {
+        println("spt_bench: {0}", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+// Process-wide counters for spt_bench. The replaceable global operator new/delete are routed
+// through here so every heap allocation made while parsing is counted, and the size of each
+// block is kept in a small header so the bytes in use and their high-water mark can be tracked.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    constexpr std::size_t headerSize { alignof(std::max_align_t) };
+
+    std::atomic<std::size_t> allocations { 0 };
+    std::atomic<std::size_t> allocated { 0 };
+    std::atomic<std::size_t> inUse { 0 };
+    std::atomic<std::size_t> peak { 0 };
+
+    void* allocate(std::size_t size) {
+        auto block { static_cast<unsigned char*>(std::malloc(size + headerSize)) };
+        if (block == nullptr) {
+            throw std::bad_alloc { };
+        }
+        *reinterpret_cast<std::size_t*>(block) = size;
+
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated.fetch_add(size, std::memory_order_relaxed);
+        auto current { inUse.fetch_add(size, std::memory_order_relaxed) + size };
+        auto highest { peak.load(std::memory_order_relaxed) };
+        while (current > highest && !peak.compare_exchange_weak(highest, current, std::memory_order_relaxed)) {
+        }
+        return block + headerSize;
+    }
+
+    void release(void* pointer) {
+        if (pointer == nullptr) {
+            return;
+        }
+        auto block { static_cast<unsigned char*>(pointer) - headerSize };
+        inUse.fetch_sub(*reinterpret_cast<std::size_t*>(block), std::memory_order_relaxed);
+        std::free(block);
+    }
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    release(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    release(pointer);
+}
+
+namespace spt::bench {
+    std::size_t allocationCount() {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    std::size_t allocatedBytes() {
+        return allocated.load(std::memory_order_relaxed);
+    }
+
+    // Restarts the high-water mark from the bytes currently in use and returns that baseline.
+    std::size_t resetHeapPeak() {
+        auto current { inUse.load(std::memory_order_relaxed) };
+        peak.store(current, std::memory_order_relaxed);
+        return current;
+    }
+
+    std::size_t heapPeak() {
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    std::size_t peakResidentBytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters { };
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return 0;
+        }
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage { };
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#if defined(__APPLE__)
+        return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+}
\ No newline at end of file
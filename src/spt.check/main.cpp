@@ -0,0 +1,387 @@
+import std;
+import spt.domain;
+import spt.infrastructure;
+
+// Checks behaviour that a benchmark run would not notice going wrong. Exits with the number of
+// failed checks, so it can run as a test.
+namespace spt::check {
+    using std::exception;
+    using std::format;
+    using std::function;
+    using std::logic_error;
+    using std::make_shared;
+    using std::pair;
+    using std::println;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::vector;
+    using std::chrono::seconds;
+    using std::chrono::steady_clock;
+    using std::chrono::microseconds;
+    using std::chrono::milliseconds;
+    using std::this_thread::sleep_for;
+    using spt::domain::investments::Portfolio;
+    using spt::domain::investments::Ticker;
+    using spt::infrastructure::net::HttpCancellationToken;
+    using spt::infrastructure::net::HttpCircuitPolicy;
+    using spt::infrastructure::net::HttpClient;
+    using spt::infrastructure::net::HttpExchange;
+    using spt::infrastructure::net::HttpHeaders;
+    using spt::infrastructure::net::HttpMethod;
+    using spt::infrastructure::net::HttpRateLimiter;
+    using spt::infrastructure::net::HttpRecording;
+    using spt::infrastructure::net::HttpReplayOptions;
+    using spt::infrastructure::net::HttpReplayServer;
+    using spt::infrastructure::net::HttpRequest;
+    using spt::infrastructure::net::HttpResponse;
+    using spt::infrastructure::net::HttpRetryPolicy;
+    using spt::infrastructure::services::FetchOutcome;
+    using spt::infrastructure::services::FetchPipelineOptions;
+    using spt::infrastructure::services::YahooPriceFetcher;
+    using spt::infrastructure::text::JsonDocument;
+    using spt::infrastructure::text::JsonEngine;
+    using spt::infrastructure::text::JsonParser;
+    using spt::infrastructure::text::JsonStreamParser;
+    using spt::infrastructure::text::JsonTape;
+    using spt::infrastructure::text::JsonValue;
+    using spt::infrastructure::text::JsonValueBuilder;
+    using spt::infrastructure::text::JsonWriter;
+
+    struct Check {
+        string name;
+        function<void()> run;
+    };
+
+    void expect(bool condition, string_view what) {
+        if (!condition) {
+            throw runtime_error { string { what } };
+        }
+    }
+
+    // An origin whose circuit opens on one failure and stays open for 50 ms, served by a
+    // replay server answering "/fail" with a 500 and "/ok" with a 200.
+    struct CircuitFixture {
+        shared_ptr<HttpRecording> recording;
+        HttpReplayServer server;
+        HttpClient client;
+        string origin;
+
+        static shared_ptr<HttpRecording> recordingOf() {
+            auto recording { make_shared<HttpRecording>() };
+            recording->add(HttpExchange { "GET", "http://origin.test/fail", 500, HttpHeaders { }, "", microseconds { 0 } });
+            recording->add(HttpExchange { "GET", "http://origin.test/ok", 200, HttpHeaders { }, "{}", microseconds { 0 } });
+            recording->add(HttpExchange { "GET", "http://origin.test/slow", 200, HttpHeaders { }, "{}", microseconds { 300000 } });
+            return recording;
+        }
+
+        CircuitFixture()
+            : recording { recordingOf() },
+              server { *recording, HttpReplayOptions { milliseconds { 0 }, milliseconds { 0 }, 0.0, 0, true, 1 } },
+              client { },
+              origin { server.origin() }
+        {
+            auto limiter { make_shared<HttpRateLimiter>(1000.0, 1000.0) };
+            limiter->retryPolicy(HttpRetryPolicy { 1, milliseconds { 1 }, milliseconds { 1 }, milliseconds { 1000 }, 0.2, 10.0 });
+            limiter->circuitPolicy(HttpCircuitPolicy { 1, milliseconds { 50 } });
+            client.rateLimiter(limiter);
+        }
+
+        HttpRequest request(string_view path) const {
+            return HttpRequest { origin + string { path }, HttpMethod::GET };
+        }
+
+        // Opens the circuit and waits until the next request is let through as the probe.
+        void open() {
+            expect(client.send(request("/fail")).status() == 500, "the failing request was not answered");
+            sleep_for(milliseconds { 60 });
+        }
+    };
+
+    void checkProbeReleasedAfterSinkError() {
+        CircuitFixture fixture { };
+        fixture.open();
+        bool thrown { false };
+        try {
+            fixture.client.send(fixture.request("/ok"), [](string_view) {
+                throw runtime_error { "sink failed" };
+            });
+        } catch (const exception&) {
+            thrown = true;
+        }
+        expect(thrown, "the sink's exception did not reach the caller");
+        expect(fixture.client.send(fixture.request("/ok")).status() == 200, "the request after the probe was not admitted");
+    }
+
+    void checkProbeReleasedAfterCancellation() {
+        CircuitFixture fixture { };
+        fixture.open();
+        HttpCancellationToken token { };
+        auto probe { fixture.client.sendAsync(fixture.request("/slow"), token) };
+        sleep_for(milliseconds { 50 });
+        token.cancel();
+        bool thrown { false };
+        try {
+            probe.get();
+        } catch (const exception&) {
+            thrown = true;
+        }
+        expect(thrown, "the cancelled probe did not fail");
+        expect(fixture.client.sendAsync(fixture.request("/ok")).get().status() == 200, "the request after the cancelled probe was not admitted");
+    }
+
+    // A request reserved before the circuit opened that ends while the probe is in flight must
+    // neither release the probe nor decide the circuit.
+    void checkOnlyTheProbeReleasesTheCircuit() {
+        HttpRateLimiter limiter { 1000.0, 1000.0 };
+        limiter.retryPolicy(HttpRetryPolicy { 1, milliseconds { 1 }, milliseconds { 1 }, milliseconds { 1000 }, 0.2, 10.0 });
+        limiter.circuitPolicy(HttpCircuitPolicy { 1, milliseconds { 50 } });
+        const string origin { "http://origin.test" };
+        auto rejects = [&limiter, &origin] {
+            try {
+                limiter.reserve(origin);
+            } catch (const exception&) {
+                return true;
+            }
+            return false;
+        };
+
+        auto late { limiter.reserve(origin) };
+        auto failing { limiter.reserve(origin) };
+        limiter.settle(origin, failing.probe, HttpResponse { 500, "", HttpHeaders { } }, 1, milliseconds { 0 });
+        expect(rejects(), "the circuit did not open");
+        sleep_for(milliseconds { 60 });
+
+        auto probe { limiter.reserve(origin) };
+        expect(probe.probe != 0 && late.probe == 0, "the probe got no ticket");
+        limiter.release(origin, late.probe);
+        expect(rejects(), "a request other than the probe released it");
+        limiter.settle(origin, late.probe, HttpResponse { 200, "", HttpHeaders { } }, 1, milliseconds { 0 });
+        expect(rejects(), "a request other than the probe closed the circuit");
+        limiter.settle(origin, probe.probe, HttpResponse { 200, "", HttpHeaders { } }, 1, milliseconds { 0 });
+        expect(!rejects(), "the probe's success did not close the circuit");
+    }
+
+    // A chart response with two points, for every symbol but "GONE", which is answered with a 404.
+    shared_ptr<HttpRecording> chartRecording(const vector<string>& symbols) {
+        auto recording { make_shared<HttpRecording>() };
+        for (const auto& symbol : symbols) {
+            recording->add(HttpExchange {
+                "GET",
+                "https://query1.finance.yahoo.com/v8/finance/chart/" + symbol + "?range=1d&interval=1m",
+                200,
+                HttpHeaders { },
+                R"({"chart":{"result":[{"timestamp":[1700000040,1700000100],"indicators":{"quote":[{"close":[1.5,2.5]}]}}]}})",
+                microseconds { 0 }
+            });
+        }
+        return recording;
+    }
+
+    void checkPipelineStopsAtFirstError() {
+        vector<string> symbols { };
+        for (int i = 0; i < 40; ++i) {
+            symbols.push_back(format("S{0}", i));
+        }
+        auto recording { chartRecording(symbols) };
+        HttpReplayServer server { *recording, HttpReplayOptions { milliseconds { 5 }, milliseconds { 0 }, 0.0, 0, false, 1 } };
+        HttpClient client { };
+        client.route("https://query1.finance.yahoo.com", server.origin());
+        YahooPriceFetcher fetcher { client };
+        fetcher.setPipeline(FetchPipelineOptions { 4, 1, 1, 2 });
+
+        Portfolio portfolio { };
+        for (const auto& symbol : symbols) {
+            portfolio.track(Ticker { symbol });
+        }
+        portfolio.track(Ticker { "GONE" });
+
+        auto started { steady_clock::now() };
+        bool thrown { false };
+        try {
+            fetcher.fetch(portfolio);
+        } catch (const exception&) {
+            thrown = true;
+        }
+        expect(thrown, "the failing symbol did not stop the fetch");
+        expect(steady_clock::now() - started < seconds { 10 }, "the pipeline took too long to wind down");
+
+        auto report { fetcher.fetchAll(portfolio) };
+        expect(report.failed == 1 && report.results.size() == symbols.size() + 1, "the report does not single out the failing symbol");
+        for (const auto& result : report.results) {
+            expect((result.ticker.symbol() == "GONE") == (result.outcome == FetchOutcome::Error), "a symbol has the wrong outcome");
+        }
+    }
+
+    struct Reader {
+        string name;
+        function<JsonValue(const string&)> read;
+    };
+
+    // Every parsing engine, each returning the whole document as a JsonValue.
+    vector<Reader> readers() {
+        return vector<Reader> {
+            { "classic", [](const string& json) { return JsonParser::parse(json, JsonEngine::Classic); } },
+            { "structural", [](const string& json) { return JsonParser::parse(json, JsonEngine::Structural); } },
+            { "stream", [](const string& json) {
+                JsonValueBuilder builder { };
+                JsonStreamParser parser { builder };
+                parser.feed(json);
+                parser.finish();
+                return builder.result();
+            } },
+            { "tape", [](const string& json) { return JsonTape::parse(json).root().toValue(); } },
+            { "document", [](const string& json) { return JsonDocument { json }.root().toValue(); } }
+        };
+    }
+
+    // Each document next to how it serializes once read, object members sorted by key.
+    void checkParsersAgree() {
+        const vector<pair<string, string>> documents {
+            {
+                R"({"chart":{"result":[{"meta":{"symbol":"MSFT"},"timestamp":[1700000040,1700000100],"indicators":{"quote":[{"close":[421.5,null,-0.25e-3]}]}}],"error":null}})",
+                R"({"chart":{"error":null,"result":[{"indicators":{"quote":[{"close":[421.5,null,-0.00025]}]},"meta":{"symbol":"MSFT"},"timestamp":[1700000040,1700000100]}]}})"
+            },
+            {
+                R"(["a\"b\\c\/d\n\t", "\u00e9\ud83d\ude00", ""])",
+                "[\"a\\\"b\\\\c/d\\n\\t\",\"\xc3\xa9\xf0\x9f\x98\x80\",\"\"]"
+            },
+            {
+                " { \"b\" : { } , \"a\" : [ ] ,\r\n\t\"c\" : true , \"d\" : false } ",
+                R"({"a":[],"b":{},"c":true,"d":false})"
+            },
+            {
+                R"({"a":1,"b":2,"a":3})",
+                R"({"a":3,"b":2})"
+            },
+            {
+                "[0,-1.5,1E2,1e-2,123456789012,0.1,1.7976931348623157e308,5e-324]",
+                "[0,-1.5,100,0.01,123456789012,0.1,1.7976931348623157e+308,5e-324]"
+            },
+            {
+                string(64, '[') + string(64, ']'),
+                string(64, '[') + string(64, ']')
+            }
+        };
+
+        for (const auto& reader : readers()) {
+            for (const auto& [json, expected] : documents) {
+                string actual { JsonWriter::serialize(reader.read(json)) };
+                expect(actual == expected, format("{0} read {1} as {2}", reader.name, json, actual));
+            }
+        }
+    }
+
+    void checkParsersRejectMalformedInput() {
+        const vector<string> documents { "", "{", "[1,]", R"({"a" 1})", R"({"a":1,})", "tru", R"("abc)", "[1] 2", "{1:2}" };
+        for (const auto& reader : readers()) {
+            for (const auto& json : documents) {
+                bool thrown { false };
+                try {
+                    reader.read(json);
+                } catch (const exception&) {
+                    thrown = true;
+                }
+                expect(thrown, format("{0} accepted {1}", reader.name, json));
+            }
+        }
+    }
+
+    // Replacing values over and over rewrites them in place or compacts the buffer; either
+    // way every field must still read back as last set.
+    void checkHeadersSurviveReplacement() {
+        HttpHeaders headers { };
+        headers.set("X-Request", "first");
+        headers.set("Authorization", "Bearer 0");
+        headers.set("Accept", "*/*");
+        for (size_t i = 0; i < 1000; ++i) {
+            string token { format("Bearer {0}", string(i % 97, 't')) };
+            headers.set("authorization", token);
+            expect(headers.get("Authorization") == token, "a replaced value reads back wrongly");
+        }
+        headers.set("Accept", *headers.get("X-Request"));
+        expect(headers.size() == 3, "replacing values changed the number of fields");
+        expect(headers.get("X-Request") == "first" && headers.get("Accept") == "first", "a field was damaged by replacing another");
+    }
+
+    void checkHeadersCombineRepeatedLines() {
+        HttpHeaders headers { };
+        for (string_view line : { "HTTP/1.1 200 OK\r\n", "Cache-Control: no-store\r\n", "Set-Cookie: a=1\r\n",
+                                  "cache-control: max-age=60\r\n", "Set-Cookie: b=2\r\n", "Vary: Accept\r\n" }) {
+            headers.parse(line);
+        }
+        expect(headers.get("Cache-Control") == "no-store, max-age=60", "repeated Cache-Control lines were not combined");
+        expect(headers.get("Set-Cookie") == "b=2", "Set-Cookie lines were combined");
+        expect(headers.size() == 3, "a repeated line added a field");
+    }
+
+    // Runs 'misuse' on a writer that has just opened an object or an array.
+    bool rejects(char container, const function<void(JsonWriter&)>& misuse) {
+        JsonWriter writer { };
+        if (container == '{') {
+            writer.onStartObject();
+        } else {
+            writer.onStartArray();
+        }
+        try {
+            misuse(writer);
+        } catch (const logic_error&) {
+            return true;
+        }
+        return false;
+    }
+
+    void checkWriterRejectsMisplacedMembers() {
+        expect(rejects('{', [](JsonWriter& writer) { writer.onNumber(1.0); }), "a number without a key was written into an object");
+        expect(rejects('{', [](JsonWriter& writer) { writer.onString("x"); }), "a string without a key was written into an object");
+        expect(rejects('{', [](JsonWriter& writer) { writer.onStartArray(); }), "an array without a key was written into an object");
+        expect(rejects('{', [](JsonWriter& writer) { writer.onKey("a"); writer.onKey("b"); }), "two keys in a row were written");
+        expect(rejects('{', [](JsonWriter& writer) { writer.onKey("a"); writer.onEndObject(); }), "an object was closed after a dangling key");
+        expect(rejects('[', [](JsonWriter& writer) { writer.onKey("a"); }), "a key was written into an array");
+
+        JsonWriter writer { };
+        writer.onStartObject();
+        writer.onKey("a");
+        writer.onStartArray();
+        writer.onNumber(1.0);
+        writer.onString("x");
+        writer.onEndArray();
+        writer.onKey("b");
+        writer.onNull();
+        writer.onEndObject();
+        expect(writer.view() == R"({"a":[1,"x"],"b":null})", "a well-formed document was written wrongly");
+    }
+
+    int run() {
+        const vector<Check> checks {
+            { "rate limiter releases a probe whose sink throws", checkProbeReleasedAfterSinkError },
+            { "rate limiter releases a cancelled probe", checkProbeReleasedAfterCancellation },
+            { "rate limiter lets only the probe release a circuit", checkOnlyTheProbeReleasesTheCircuit },
+            { "price pipeline stops at the first error", checkPipelineStopsAtFirstError },
+            { "json parsers read documents alike", checkParsersAgree },
+            { "json parsers reject malformed documents", checkParsersRejectMalformedInput },
+            { "http headers keep their fields when values are replaced", checkHeadersSurviveReplacement },
+            { "http headers combine repeated lines", checkHeadersCombineRepeatedLines },
+            { "json writer rejects misplaced keys and values", checkWriterRejectsMisplacedMembers }
+        };
+
+        int failed { 0 };
+        for (const auto& check : checks) {
+            try {
+                check.run();
+                println("ok      {0}", check.name);
+            } catch (const exception& e) {
+                println("FAILED  {0}: {1}", check.name, e.what());
+                ++failed;
+            }
+        }
+        println("{0} of {1} checks passed", checks.size() - static_cast<size_t>(failed), checks.size());
+        return failed;
+    }
+}
+
+int main() {
+    return spt::check::run();
+}
\ No newline at end of file
@@ -119,6 +119,17 @@ namespace spt::domain::investments {
                 _pricePoints.emplace(timestamp, newPrice);
             }
 
+            // The latest price can still change while its period is open, like the close of the
+            // current minute; this replaces it and keeps its timestamp.
+            void reviseLatestPrice(Price newPrice) {
+                if (_pricePoints.empty()) {
+                    throw invalid_argument { "There is no price to revise" };
+                }
+                system_clock::time_point stamp { _pricePoints.top().stamp() };
+                _pricePoints.pop();
+                _pricePoints.emplace(stamp, newPrice);
+            }
+
             system_clock::time_point latestPriceTimestamp() const {
                 if (_pricePoints.empty()) {
                     return system_clock::time_point{}; // Return epoch if no prices
@@ -0,0 +1,99 @@
+export module spt.infrastructure:boundedqueue;
+
+import std;
+
+namespace spt::infrastructure::services {
+    using std::condition_variable;
+    using std::deque;
+    using std::invalid_argument;
+    using std::lock_guard;
+    using std::move;
+    using std::mutex;
+    using std::nullopt;
+    using std::optional;
+    using std::size_t;
+    using std::unique_lock;
+
+    // Hands items from one set of threads to another. push() blocks while the queue is full,
+    // which is what slows a fast producer down to the pace of its consumers.
+    export template <typename T>
+    class BoundedQueue final {
+        private:
+            mutable mutex _mutex;
+            condition_variable _notEmpty;
+            condition_variable _notFull;
+            deque<T> _items;
+            size_t _capacity;
+            bool _closed;
+            size_t _stalls;
+
+        public:
+            explicit BoundedQueue(size_t capacity)
+                : _mutex { },
+                  _notEmpty { },
+                  _notFull { },
+                  _items { },
+                  _capacity { capacity },
+                  _closed { false },
+                  _stalls { 0 }
+            {
+                if (capacity == 0) {
+                    throw invalid_argument { "A queue needs room for at least one item" };
+                }
+            }
+
+            BoundedQueue(const BoundedQueue&) = delete;
+            BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+            // Waits for room; returns false, dropping 'item', once the queue is closed.
+            bool push(T item) {
+                unique_lock<mutex> lock { _mutex };
+                if (_items.size() >= _capacity && !_closed) {
+                    ++_stalls;
+                    _notFull.wait(lock, [this] { return _items.size() < _capacity || _closed; });
+                }
+                if (_closed) {
+                    return false;
+                }
+                _items.push_back(move(item));
+                _notEmpty.notify_one();
+                return true;
+            }
+
+            // Waits for an item; nullopt once the queue is closed and drained.
+            optional<T> pop() {
+                unique_lock<mutex> lock { _mutex };
+                _notEmpty.wait(lock, [this] { return !_items.empty() || _closed; });
+                if (_items.empty()) {
+                    return nullopt;
+                }
+                T item { move(_items.front()) };
+                _items.pop_front();
+                _notFull.notify_one();
+                return item;
+            }
+
+            // No more items are accepted; those already queued can still be popped.
+            void close() {
+                lock_guard<mutex> lock { _mutex };
+                _closed = true;
+                _notEmpty.notify_all();
+                _notFull.notify_all();
+            }
+
+            // Closes the queue and drops what is still in it.
+            void abort() {
+                lock_guard<mutex> lock { _mutex };
+                _closed = true;
+                _items.clear();
+                _notEmpty.notify_all();
+                _notFull.notify_all();
+            }
+
+            // How many pushes had to wait for room.
+            size_t stalls() const {
+                lock_guard<mutex> lock { _mutex };
+                return _stalls;
+            }
+    };
+}
\ No newline at end of file
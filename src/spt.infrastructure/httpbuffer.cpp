@@ -0,0 +1,173 @@
+export module spt.infrastructure:httpbuffer;
+
+import std;
+
+namespace spt::infrastructure::net {
+    using std::lock_guard;
+    using std::make_shared;
+    using std::move;
+    using std::mutex;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    export struct HttpBufferStats {
+        size_t acquired;
+        size_t reused;      // acquired without allocating
+        size_t released;
+        size_t dropped;     // released while the pool was full, or too large to keep
+    };
+
+    // Recycles response body buffers. A released buffer keeps its capacity, so once the pool
+    // has warmed up to the sizes a client downloads, bodies are written without allocating.
+    export class HttpBufferPool final {
+        private:
+            mutable mutex _mutex;
+            vector<string> _free;
+            size_t _maxBuffers;
+            size_t _maxCapacity;
+            HttpBufferStats _stats;
+
+        public:
+            HttpBufferPool(size_t maxBuffers = 32, size_t maxCapacity = 8 * 1024 * 1024)
+                : _mutex { },
+                  _free { },
+                  _maxBuffers { maxBuffers },
+                  _maxCapacity { maxCapacity },
+                  _stats { }
+            {
+                // so parking a buffer never allocates
+                _free.reserve(maxBuffers);
+            }
+
+            HttpBufferPool(const HttpBufferPool&) = delete;
+            HttpBufferPool& operator=(const HttpBufferPool&) = delete;
+
+            // The pool every response body is taken from.
+            static const shared_ptr<HttpBufferPool>& shared() {
+                static const shared_ptr<HttpBufferPool> pool { make_shared<HttpBufferPool>() };
+                return pool;
+            }
+
+            HttpBufferStats stats() const {
+                lock_guard<mutex> lock { _mutex };
+                return _stats;
+            }
+
+            // An empty buffer with room for at least 'capacity' bytes: the smallest parked one
+            // that fits, otherwise the largest, grown as needed.
+            string acquire(size_t capacity) {
+                string result { };
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    ++_stats.acquired;
+                    if (!_free.empty()) {
+                        size_t best { _free.size() };
+                        size_t largest { 0 };
+                        for (size_t i = 0; i < _free.size(); ++i) {
+                            if (_free[i].capacity() >= capacity && (best == _free.size() || _free[i].capacity() < _free[best].capacity())) {
+                                best = i;
+                            }
+                            if (_free[i].capacity() > _free[largest].capacity()) {
+                                largest = i;
+                            }
+                        }
+                        if (best == _free.size()) {
+                            best = largest;
+                        }
+                        result = move(_free[best]);
+                        _free[best] = move(_free.back());
+                        _free.pop_back();
+                        if (result.capacity() >= capacity) {
+                            ++_stats.reused;
+                        }
+                    }
+                }
+                result.clear();
+                result.reserve(capacity);
+                return result;
+            }
+
+            void release(string buffer) {
+                lock_guard<mutex> lock { _mutex };
+                ++_stats.released;
+                if (_free.size() >= _maxBuffers || buffer.capacity() > _maxCapacity) {
+                    ++_stats.dropped;
+                    return;
+                }
+                _free.push_back(move(buffer));
+            }
+    };
+
+    // A response body. One taken from a pool goes back to it when destroyed; copies are plain
+    // strings, so only the original is ever returned.
+    export class HttpBuffer final {
+        private:
+            shared_ptr<HttpBufferPool> _pool;
+            string _data;
+
+        public:
+            HttpBuffer()
+                : _pool { },
+                  _data { }
+            {
+            }
+
+            explicit HttpBuffer(string data)
+                : _pool { },
+                  _data { move(data) }
+            {
+            }
+
+            HttpBuffer(shared_ptr<HttpBufferPool> pool, size_t capacity)
+                : _pool { move(pool) },
+                  _data { _pool->acquire(capacity) }
+            {
+            }
+
+            HttpBuffer(const HttpBuffer& other)
+                : _pool { },
+                  _data { other._data }
+            {
+            }
+
+            HttpBuffer(HttpBuffer&& other) noexcept
+                : _pool { move(other._pool) },
+                  _data { move(other._data) }
+            {
+            }
+
+            HttpBuffer& operator=(HttpBuffer other) {
+                if (_pool != nullptr) {
+                    _pool->release(move(_data));
+                }
+                _pool = move(other._pool);
+                _data = move(other._data);
+                return *this;
+            }
+
+            ~HttpBuffer() {
+                if (_pool != nullptr) {
+                    _pool->release(move(_data));
+                }
+            }
+
+            void append(string_view chunk) {
+                _data.append(chunk);
+            }
+
+            string_view view() const {
+                return _data;
+            }
+
+            size_t size() const {
+                return _data.size();
+            }
+
+            bool empty() const {
+                return _data.empty();
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,421 @@
+export module spt.infrastructure:httpcache;
+
+import std;
+import :database;
+import :httpbuffer;
+import :httpheaders;
+import :httprequest;
+import :httpresponse;
+
+namespace spt::infrastructure::net {
+    using std::byte;
+    using std::errc;
+    using std::from_chars;
+    using std::list;
+    using std::lock_guard;
+    using std::max;
+    using std::min;
+    using std::move;
+    using std::mutex;
+    using std::nullopt;
+    using std::optional;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::unordered_map;
+    using std::chrono::days;
+    using std::chrono::duration_cast;
+    using std::chrono::seconds;
+    using std::chrono::sys_seconds;
+    using std::chrono::system_clock;
+    using std::chrono::time_point_cast;
+    using spt::infrastructure::sql::Database;
+    using spt::infrastructure::sql::Value;
+
+    export struct HttpCacheStats {
+        size_t hits;            // served without touching the network
+        size_t revalidated;     // answered by the server with 304 Not Modified
+        size_t misses;          // went to the network, revalidations included
+        size_t stored;
+        size_t evicted;
+    };
+
+    // Private HTTP cache for GET responses (RFC 9111). Fresh responses are answered from
+    // memory, stale ones that carry an ETag or Last-Modified are revalidated with a conditional
+    // request, and a 304 refreshes the stored copy. Memory use is bounded by evicting the least
+    // recently used entries; with a database every stored response is also written through to
+    // it, so lookups survive a restart.
+    export class HttpCache final {
+        private:
+            struct Entry {
+                string url;
+                long status;
+                string body;
+                HttpHeaders headers;
+                sys_seconds storedAt;
+                seconds lifetime;       // how long after storedAt the entry is fresh
+                bool revalidate;        // no-cache: always ask the server first
+
+                size_t footprint() const {
+                    size_t result { url.size() + body.size() };
+                    for (const auto& [key, value] : headers) {
+                        result += key.size() + value.size();
+                    }
+                    return result;
+                }
+            };
+
+            struct Directives {
+                bool noStore { false };
+                bool noCache { false };
+                optional<seconds> maxAge { };
+            };
+
+            static constexpr string_view schema {
+                "CREATE TABLE IF NOT EXISTS http_cache ("
+                "url TEXT PRIMARY KEY, status INTEGER NOT NULL, headers TEXT NOT NULL, body BLOB, "
+                "stored_at INTEGER NOT NULL, lifetime INTEGER NOT NULL, revalidate INTEGER NOT NULL)"
+            };
+
+            // stale rows that were not refreshed for this long are dropped when the cache opens
+            static constexpr days retention { 30 };
+
+            mutex _mutex;
+            size_t _maxBytes;
+            size_t _bytes;
+            list<Entry> _entries;   // most recently used first
+            unordered_map<string_view, list<Entry>::iterator> _index;
+            shared_ptr<Database> _database;
+            HttpCacheStats _stats;
+
+            // Updates the stored headers with those of a 304; the body length is the stored one.
+            static void merge(HttpHeaders& stored, const HttpHeaders& updated) {
+                for (const auto& [name, value] : updated) {
+                    if (!HttpHeaders::equalsIgnoreCase(name, "Content-Length")) {
+                        stored.set(name, value);
+                    }
+                }
+            }
+
+            static string_view trim(string_view text) {
+                auto first { text.find_first_not_of(" \t") };
+                if (first == string_view::npos) {
+                    return { };
+                }
+                auto last { text.find_last_not_of(" \t") };
+                return text.substr(first, last - first + 1);
+            }
+
+            static optional<long long> parseInteger(string_view text) {
+                long long value { 0 };
+                auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+                if (ec != errc { } || end != text.data() + text.size() || value < 0) {
+                    return nullopt;
+                }
+                return value;
+            }
+
+            static Directives parseCacheControl(optional<string_view> value) {
+                Directives result { };
+                if (!value.has_value()) {
+                    return result;
+                }
+                string_view rest { *value };
+                while (!rest.empty()) {
+                    auto comma { rest.find(',') };
+                    string_view directive { trim(rest.substr(0, comma)) };
+                    rest = comma == string_view::npos ? string_view { } : rest.substr(comma + 1);
+
+                    auto equals { directive.find('=') };
+                    string_view name { trim(directive.substr(0, equals)) };
+                    string_view argument { equals == string_view::npos ? string_view { } : trim(directive.substr(equals + 1)) };
+                    if (argument.size() >= 2 && argument.front() == '"' && argument.back() == '"') {
+                        argument = argument.substr(1, argument.size() - 2);
+                    }
+
+                    if (HttpHeaders::equalsIgnoreCase(name, "no-store")) {
+                        result.noStore = true;
+                    } else if (HttpHeaders::equalsIgnoreCase(name, "no-cache")) {
+                        result.noCache = true;
+                    } else if (HttpHeaders::equalsIgnoreCase(name, "max-age")) {
+                        // an invalid max-age makes the response stale
+                        result.maxAge = seconds { parseInteger(argument).value_or(0) };
+                    }
+                }
+                return result;
+            }
+
+            static sys_seconds now() {
+                return time_point_cast<seconds>(system_clock::now());
+            }
+
+            // Freshness lifetime from max-age, Expires, or the usual heuristic of a tenth of the
+            // time since Last-Modified (at most a day); Age counts against it.
+            static seconds lifetimeOf(const HttpHeaders& headers, const Directives& directives) {
+                seconds result { 0 };
+                auto date { HttpHeaders::parseDate(headers.get("Date").value_or("")) };
+                if (directives.maxAge.has_value()) {
+                    result = *directives.maxAge;
+                } else if (auto expires = headers.get("Expires"); expires.has_value()) {
+                    auto expiry { HttpHeaders::parseDate(*expires) };
+                    if (expiry.has_value()) {
+                        result = *expiry - date.value_or(now());
+                    }
+                } else if (auto modified = HttpHeaders::parseDate(headers.get("Last-Modified").value_or("")); modified.has_value()) {
+                    result = min(duration_cast<seconds>((date.value_or(now()) - *modified) / 10), seconds { days { 1 } });
+                }
+
+                auto age { parseInteger(trim(headers.get("Age").value_or(""))) };
+                if (age.has_value()) {
+                    result -= seconds { *age };
+                }
+                return max(result, seconds { 0 });
+            }
+
+            static bool hasValidators(const Entry& entry) {
+                return entry.headers.get("ETag").has_value() || entry.headers.get("Last-Modified").has_value();
+            }
+
+            static bool isFresh(const Entry& entry) {
+                return !entry.revalidate && now() < entry.storedAt + entry.lifetime;
+            }
+
+            static HttpResponse responseOf(const Entry& entry) {
+                HttpBuffer body { HttpBufferPool::shared(), entry.body.size() };
+                body.append(entry.body);
+                return HttpResponse { entry.status, move(body), entry.headers, HttpBodySize { 0, entry.body.size() } };
+            }
+
+            static string serialize(const HttpHeaders& headers) {
+                string result { };
+                for (const auto& [key, value] : headers) {
+                    result.append(key).append(": ").append(value).append("\r\n");
+                }
+                return result;
+            }
+
+            static HttpHeaders deserialize(string_view text) {
+                HttpHeaders result { };
+                while (!text.empty()) {
+                    auto end { text.find("\r\n") };
+                    result.parse(text.substr(0, end));
+                    text = end == string_view::npos ? string_view { } : text.substr(end + 2);
+                }
+                return result;
+            }
+
+            // Moves the entry for 'url' to the front, loading it from the database on a memory
+            // miss. Called with the mutex held.
+            Entry* find(const string& url) {
+                auto it { _index.find(url) };
+                if (it != _index.end()) {
+                    _entries.splice(_entries.begin(), _entries, it->second);
+                    return &*it->second;
+                }
+                if (_database == nullptr) {
+                    return nullptr;
+                }
+
+                auto rows {
+                    _database->query(
+                        "SELECT status, headers, body, stored_at, lifetime, revalidate FROM http_cache WHERE url = ?",
+                        { Value { url } }
+                    )
+                };
+                for (const auto& row : rows) {
+                    string body { };
+                    if (const auto& blob = row.get("body"); blob.isBlob()) {
+                        body.assign(reinterpret_cast<const char*>(blob.getBlob().data()), blob.getBlob().size());
+                    }
+                    Entry entry {
+                        url,
+                        static_cast<long>(row.get("status").getLong()),
+                        move(body),
+                        deserialize(row.get("headers").getString()),
+                        sys_seconds { seconds { row.get("stored_at").getLong() } },
+                        seconds { row.get("lifetime").getLong() },
+                        row.get("revalidate").getLong() != 0
+                    };
+                    return &insert(move(entry), false);
+                }
+                return nullptr;
+            }
+
+            // Stores 'entry' in memory (and in the database when 'persist'), evicting the least
+            // recently used entries past the byte limit. Called with the mutex held.
+            Entry& insert(Entry entry, bool persist) {
+                if (persist && _database != nullptr) {
+                    Value::blob body { reinterpret_cast<const byte*>(entry.body.data()), reinterpret_cast<const byte*>(entry.body.data() + entry.body.size()) };
+                    _database->execute(
+                        "INSERT OR REPLACE INTO http_cache (url, status, headers, body, stored_at, lifetime, revalidate) VALUES (?, ?, ?, ?, ?, ?, ?)",
+                        {
+                            Value { entry.url },
+                            Value { static_cast<long long>(entry.status) },
+                            Value { serialize(entry.headers) },
+                            Value { move(body) },
+                            Value { static_cast<long long>(entry.storedAt.time_since_epoch().count()) },
+                            Value { static_cast<long long>(entry.lifetime.count()) },
+                            Value { entry.revalidate ? 1 : 0 }
+                        }
+                    );
+                }
+
+                erase(entry.url);
+                _bytes += entry.footprint();
+                _entries.push_front(move(entry));
+                _index.emplace(_entries.front().url, _entries.begin());
+
+                while (_bytes > _maxBytes && _entries.size() > 1) {
+                    erase(_entries.back().url);
+                    ++_stats.evicted;
+                }
+                return _entries.front();
+            }
+
+            void erase(const string& url) {
+                auto it { _index.find(url) };
+                if (it == _index.end()) {
+                    return;
+                }
+                auto entry { it->second };
+                _bytes -= entry->footprint();
+                _index.erase(it);
+                _entries.erase(entry);
+            }
+
+            // Stores a cacheable response, or refreshes the stored copy on a 304 and returns it.
+            optional<HttpResponse> store(const HttpRequest& request, const HttpResponse& response, string_view body) {
+                if (request.method() != HttpMethod::GET) {
+                    return nullopt;
+                }
+                auto directives { parseCacheControl(response.headers().get("Cache-Control")) };
+                auto requested { parseCacheControl(request.headers().get("Cache-Control")) };
+                string url { request.url() };
+
+                lock_guard<mutex> lock { _mutex };
+                if (response.status() == 304) {
+                    Entry* stored { find(url) };
+                    if (stored == nullptr) {
+                        return nullopt;
+                    }
+                    Entry refreshed { *stored };
+                    merge(refreshed.headers, response.headers());
+                    auto merged { parseCacheControl(refreshed.headers.get("Cache-Control")) };
+                    refreshed.storedAt = now();
+                    refreshed.lifetime = lifetimeOf(refreshed.headers, merged);
+                    refreshed.revalidate = merged.noCache;
+                    ++_stats.revalidated;
+                    return responseOf(insert(move(refreshed), true));
+                }
+
+                // only complete 200 responses whose representation does not depend on request
+                // headers other than the encoding libcurl already negotiates and decodes
+                auto vary { response.headers().get("Vary") };
+                bool varies { vary.has_value() && !HttpHeaders::equalsIgnoreCase(trim(*vary), "Accept-Encoding") };
+                if (response.status() != 200 || directives.noStore || requested.noStore || varies) {
+                    return nullopt;
+                }
+                auto lifetime { lifetimeOf(response.headers(), directives) };
+                Entry entry { url, response.status(), string { body }, response.headers(), now(), lifetime, directives.noCache };
+                if (lifetime == seconds { 0 } && !hasValidators(entry)) {
+                    return nullopt;    // would never be served
+                }
+                if (entry.footprint() <= _maxBytes) {
+                    insert(move(entry), true);
+                    ++_stats.stored;
+                }
+                return nullopt;
+            }
+
+        public:
+            explicit HttpCache(size_t maxBytes = 16u << 20)
+                : _mutex { },
+                  _maxBytes { maxBytes },
+                  _bytes { 0 },
+                  _entries { },
+                  _index { },
+                  _database { },
+                  _stats { }
+            {
+            }
+
+            HttpCache(size_t maxBytes, shared_ptr<Database> database)
+                : HttpCache(maxBytes)
+            {
+                _database = move(database);
+                _database->execute(schema);
+                auto cutoff { now() - seconds { retention } };
+                _database->execute(
+                    "DELETE FROM http_cache WHERE stored_at + lifetime < ?",
+                    { Value { static_cast<long long>(cutoff.time_since_epoch().count()) } }
+                );
+            }
+
+            HttpCache(const HttpCache&) = delete;
+            HttpCache& operator=(const HttpCache&) = delete;
+
+            HttpCacheStats stats() {
+                lock_guard<mutex> lock { _mutex };
+                return _stats;
+            }
+
+            size_t size() {
+                lock_guard<mutex> lock { _mutex };
+                return _entries.size();
+            }
+
+            // Returns the stored response when it is still fresh. Otherwise, when a stale copy
+            // carries validators, makes 'request' conditional so the server can answer 304.
+            optional<HttpResponse> lookup(HttpRequest& request) {
+                if (request.method() != HttpMethod::GET) {
+                    return nullopt;
+                }
+                auto requested { parseCacheControl(request.headers().get("Cache-Control")) };
+                if (requested.noStore) {
+                    return nullopt;
+                }
+
+                lock_guard<mutex> lock { _mutex };
+                Entry* entry { find(string { request.url() }) };
+                if (entry == nullptr) {
+                    ++_stats.misses;
+                    return nullopt;
+                }
+                if (!requested.noCache && isFresh(*entry)) {
+                    ++_stats.hits;
+                    return responseOf(*entry);
+                }
+
+                ++_stats.misses;
+                if (auto etag = entry->headers.get("ETag"); etag.has_value()) {
+                    request.setHeader("If-None-Match", *etag);
+                }
+                if (auto modified = entry->headers.get("Last-Modified"); modified.has_value()) {
+                    request.setHeader("If-Modified-Since", *modified);
+                }
+                return nullopt;
+            }
+
+            // Takes back the validators lookup() added, to ask again after a 304 whose entry was
+            // evicted in the meantime. Returns whether there were any.
+            static bool unconditional(HttpRequest& request) {
+                bool etag { request.removeHeader("If-None-Match") };
+                bool modified { request.removeHeader("If-Modified-Since") };
+                return etag || modified;
+            }
+
+            // Takes the server's answer to a request that went through lookup(). A 304 refreshes
+            // the stored copy and is replaced by it; a cacheable 200 is stored.
+            HttpResponse complete(const HttpRequest& request, HttpResponse response) {
+                auto stored { store(request, response, response.body()) };
+                return stored.has_value() ? move(*stored) : move(response);
+            }
+
+            // As above for a response whose body was streamed to a sink; 'body' is the full body.
+            HttpResponse complete(const HttpRequest& request, HttpResponse response, string_view body) {
+                auto stored { store(request, response, body) };
+                return stored.has_value() ? move(*stored) : move(response);
+            }
+    };
+}
\ No newline at end of file
@@ -3,20 +3,34 @@ export module spt.infrastructure:httpclient;
 import <curl/curl.h>;
 
 import std;
+import :httpcache;
+import :httpconnectionpool;
+import :httpeventloop;
+import :httpmetrics;
+import :httpratelimiter;
+import :httprecording;
 import :httprequest;
 import :httpresponse;
+import :httptransfer;
 
 namespace spt::infrastructure::net {
     using std::atexit;
     using std::format;
+    using std::future;
     using std::invalid_argument;    
-    using std::istringstream;
+    using std::make_shared;
     using std::move;
-    using std::runtime_error;
+    using std::nullopt;
+    using std::optional;
+    using std::promise;
+    using std::shared_ptr;
     using std::size_t;
     using std::string;
     using std::string_view;
-    using std::unique_ptr;
+    using std::unordered_map;
+    using std::vector;
+    using std::chrono::milliseconds;
+    using std::this_thread::sleep_for;
     using spt::infrastructure::net::HttpHeaders;
     using spt::infrastructure::net::HttpMethod;
     using spt::infrastructure::net::HttpRequest;
@@ -24,8 +38,19 @@ namespace spt::infrastructure::net {
 
     export class HttpClient final {
         public:
+            using body_sink_t = HttpTransfer::body_sink_t;
+
             HttpClient() 
-                : _timeout { 30L }
+                : _timeout { 30L },
+                  _version { HttpVersion::Http1 },
+                  _compressed { true },
+                  _cache { },
+                  _limiter { },
+                  _recording { },
+                  _metrics { },
+                  _routes { },
+                  _pool { },
+                  _loop { }
             {
                 static bool init = false;
                 if (!init) {
@@ -35,8 +60,14 @@ namespace spt::infrastructure::net {
                     });
                     init = true;
                 }
+                _pool = make_shared<HttpConnectionPool>();
+                _loop = make_shared<HttpEventLoop>(_pool);
             }
 
+            // Copies share the connection pool and the event loop.
+            HttpClient(const HttpClient&) = default;
+            HttpClient& operator=(const HttpClient&) = default;
+
             long timeout() const {
                 return _timeout;
             }
@@ -50,120 +81,291 @@ namespace spt::infrastructure::net {
                 _timeout = value;
             }
 
-            HttpResponse send(const HttpRequest& request) const {
-                curl_t curl { makeCurl() };
-                curl_list_t headers { makeHeaders(request.headers()) };
-                
-                string responseBody { };
-                string headerBuffer { };
-
-                curl_easy_setopt(curl.get(), CURLOPT_URL, request.url().data());
-                curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
-                curl_easy_setopt(curl.get(), CURLOPT_TIMEOUT, _timeout);
-                curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, writeCallback);
-                curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &responseBody);
-                curl_easy_setopt(curl.get(), CURLOPT_HEADERFUNCTION, headerCallback);
-                curl_easy_setopt(curl.get(), CURLOPT_HEADERDATA, &headerBuffer);
-                curl_easy_setopt(curl.get(), CURLOPT_HTTPHEADER, headers.get());
-                curl_easy_setopt(curl.get(), CURLOPT_USERAGENT, "HttpClient/2.0");
-                curl_easy_setopt(curl.get(), CURLOPT_SSL_VERIFYPEER, 1L);
-                curl_easy_setopt(curl.get(), CURLOPT_SSL_VERIFYHOST, 2L);
-                
-                string body { request.body() };
-                switch (request.method()) {
-                    case HttpMethod::POST:
-                        curl_easy_setopt(curl.get(), CURLOPT_POST, 1L);
-                        curl_easy_setopt(curl.get(), CURLOPT_POSTFIELDS, body.c_str());
-                        curl_easy_setopt(curl.get(), CURLOPT_POSTFIELDSIZE, body.size());
-                        break;
-                    case HttpMethod::PUT:
-                        curl_easy_setopt(curl.get(), CURLOPT_CUSTOMREQUEST, "PUT");
-                        curl_easy_setopt(curl.get(), CURLOPT_POSTFIELDS, body.c_str());
-                        curl_easy_setopt(curl.get(), CURLOPT_POSTFIELDSIZE, body.size());
-                        break;
-                    case HttpMethod::DEL:
-                        curl_easy_setopt(curl.get(), CURLOPT_CUSTOMREQUEST, "DELETE");
-                        break;
-                    case HttpMethod::GET:
-                    default:
-                        curl_easy_setopt(curl.get(), CURLOPT_HTTPGET, 1L);
-                        break;
-                }
-
-                CURLcode result { curl_easy_perform(curl.get()) };
-                if (result != CURLE_OK) {
-                    throw runtime_error {
-                        format("Error performing the request: {0}", curl_easy_strerror(result))
-                    };
+            HttpVersion httpVersion() const {
+                return _version;
+            }
+
+            // HTTP/2 only pays off for sendAsync and sendAll, where concurrent requests to one
+            // origin share a connection; send() runs one request per handle either way.
+            void httpVersion(HttpVersion value) {
+                _version = value;
+            }
+
+            bool compressed() const {
+                return _compressed;
+            }
+
+            // On by default: responses are requested compressed and decoded while they
+            // download. The bytes saved show in HttpResponse::bodySize() and stats().
+            void compressed(bool value) {
+                _compressed = value;
+            }
+
+            // The content encodings the linked libcurl can decode, as offered in Accept-Encoding.
+            static string encodings() {
+                const auto* info { curl_version_info(CURLVERSION_NOW) };
+                string result { };
+                if ((info->features & CURL_VERSION_LIBZ) != 0) {
+                    result = "gzip, deflate";
+                }
+                if ((info->features & CURL_VERSION_BROTLI) != 0) {
+                    result += result.empty() ? "br" : ", br";
                 }
+                if ((info->features & CURL_VERSION_ZSTD) != 0) {
+                    result += result.empty() ? "zstd" : ", zstd";
+                }
+                return result;
+            }
 
-                long code { 0L };
-                curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &code);
+            shared_ptr<HttpCache> cache() const {
+                return _cache;
+            }
 
-                HttpResponse response { 
-                    code, 
-                    move(responseBody), 
-                    parseHeaders(headerBuffer)
-                };
-                
-                return response;
+            // Responses to GET requests go through 'value' (nullptr for none): fresh copies are
+            // answered locally and stale ones revalidated with a conditional request.
+            void cache(shared_ptr<HttpCache> value) {
+                _cache = move(value);
             }
 
-        private:
-            using curl_t = unique_ptr<CURL, decltype(&curl_easy_cleanup)>;
-            using curl_list_t = unique_ptr<curl_slist, decltype(&curl_slist_free_all)>;
-            
-            long _timeout;
+            shared_ptr<HttpRateLimiter> rateLimiter() const {
+                return _limiter;
+            }
+
+            // Requests go through 'value' (nullptr for none): they are paced per origin, failed
+            // attempts are retried with backoff and an origin that keeps failing is cut off for
+            // a while. Share one limiter between clients talking to the same servers.
+            void rateLimiter(shared_ptr<HttpRateLimiter> value) {
+                _limiter = move(value);
+            }
+
+            shared_ptr<HttpRecording> recording() const {
+                return _recording;
+            }
+
+            // Every response that comes from the network is added to 'value' (nullptr to stop
+            // recording), attempts that are retried included; cache hits are not.
+            void recording(shared_ptr<HttpRecording> value) {
+                _recording = move(value);
+            }
+
+            shared_ptr<HttpMetrics> metrics() const {
+                return _metrics;
+            }
+
+            // Timings of every response that comes from the network are added to 'value'
+            // (nullptr to stop), per endpoint; copies of the client made afterwards share it.
+            void metrics(shared_ptr<HttpMetrics> value) {
+                _metrics = move(value);
+            }
+
+            // Requests for 'origin' ("scheme://host[:port]") go to 'target' instead, with the
+            // same path and query, e.g. to an HttpReplayServer standing in for the real service.
+            void route(string_view origin, string_view target) {
+                _routes[HttpRequest::originOf(origin)] = string { target };
+            }
+
+            size_t maxConcurrentStreams() const {
+                return _loop->maxConcurrentStreams();
+            }
+
+            void maxConcurrentStreams(size_t value) {
+                _loop->maxConcurrentStreams(value);
+            }
+
+            size_t maxConnectionsPerHost() const {
+                return _pool->maxPerHost();
+            }
+
+            void maxConnectionsPerHost(size_t value) {
+                _pool->maxPerHost(value);
+            }
+
+            HttpPoolStats stats() const {
+                return _pool->stats();
+            }
+
+            HttpResponse send(const HttpRequest& request) const {
+                return send(request, nullptr);
+            }
 
-            static curl_t makeCurl() {
-                CURL* raw = curl_easy_init();
-                if (raw == nullptr) {
-                    throw runtime_error("Failed to initialize CURL");
+            // Hands every chunk of a successful (2xx) body to 'sink' as libcurl receives it
+            // instead of buffering it; the returned response then has an empty body. Bodies of
+            // other responses are still buffered so callers can inspect them.
+            HttpResponse send(const HttpRequest& request, body_sink_t sink) const {
+                if (auto routed = routedOf(request); routed.has_value()) {
+                    return send(*routed, move(sink));
+                }
+                if (_cache == nullptr) {
+                    return perform(request, move(sink));
+                }
+
+                HttpRequest conditional { request };
+                auto cached { _cache->lookup(conditional) };
+                if (cached.has_value()) {
+                    return deliver(move(*cached), sink);
+                }
+                if (!sink) {
+                    auto response { _cache->complete(conditional, perform(conditional, nullptr)) };
+                    // a 304 for an entry evicted in the meantime; ask again unconditionally
+                    return response.status() == 304 ? perform(request, nullptr) : response;
                 }
 
-                return { raw, &curl_easy_cleanup };
+                // the streamed body is kept aside so it can be stored
+                string body { };
+                auto response { perform(conditional, [&body, &sink](string_view chunk) {
+                    body.append(chunk);
+                    sink(chunk);
+                }) };
+                if (response.status() == 304) {
+                    response = _cache->complete(conditional, move(response));
+                    return response.status() == 304 ? perform(request, move(sink)) : deliver(move(response), sink);
+                }
+                return _cache->complete(conditional, move(response), body);
+            }
+
+            // Queues the request on the client's event loop and returns at once. The future
+            // throws what send() would have thrown, or when 'token' is cancelled or the
+            // request deadline passes first. Retries wait on the loop, not on a thread.
+            future<HttpResponse> sendAsync(const HttpRequest& request, HttpCancellationToken token = { }) const {
+                return move(sendAll(vector<HttpRequest> { request }, move(token)).front());
             }
 
-            static curl_list_t makeHeaders(const HttpHeaders& headers) {
-                struct curl_slist* list { nullptr };
-                for (const auto& [k, v] : headers) {
-                    string str { k + ": " + v };
-                    list = curl_slist_append(list, str.c_str());
+            // Queues every request at once; the futures are in the same order as 'requests'.
+            // Requests the cache can answer get a ready future without being queued.
+            vector<future<HttpResponse>> sendAll(const vector<HttpRequest>& requests, HttpCancellationToken token = { }) const {
+                if (!_routes.empty()) {
+                    vector<HttpRequest> routed { };
+                    routed.reserve(requests.size());
+                    for (const auto& request : requests) {
+                        routed.push_back(routedOf(request).value_or(request));
+                    }
+                    return sendRouted(routed, move(token));
                 }
-                return { list, &curl_slist_free_all };
+                return sendRouted(requests, move(token));
+            }
+
+        private:
+            long _timeout;
+            HttpVersion _version;
+            bool _compressed;
+            shared_ptr<HttpCache> _cache;
+            shared_ptr<HttpRateLimiter> _limiter;
+            shared_ptr<HttpRecording> _recording;
+            shared_ptr<HttpMetrics> _metrics;
+            unordered_map<string, string> _routes;
+            shared_ptr<HttpConnectionPool> _pool;
+            shared_ptr<HttpEventLoop> _loop;
+
+            HttpTransferOptions options() const {
+                return HttpTransferOptions { _timeout, _version, _compressed, _recording, _metrics };
             }
 
-            static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-                auto* s = static_cast<std::string*>(userp);
-                s->append(static_cast<char*>(contents), size * nmemb);
-                return size * nmemb;
+            // 'request' sent to its route's target, or nullopt when its origin has no route.
+            optional<HttpRequest> routedOf(const HttpRequest& request) const {
+                if (_routes.empty()) {
+                    return nullopt;
+                }
+                string origin { request.origin() };
+                auto route { _routes.find(origin) };
+                if (route == _routes.end()) {
+                    return nullopt;
+                }
+                HttpRequest result { request };
+                result.setUrl(route->second + string { request.url().substr(origin.size()) });
+                return result;
             }
 
-            static size_t headerCallback(void* buffer, size_t size, size_t nitems, void* userp) {
-                auto* s = static_cast<std::string*>(userp);
-                s->append(static_cast<char*>(buffer), size * nitems);
-                return size * nitems;
+            vector<future<HttpResponse>> sendRouted(const vector<HttpRequest>& requests, HttpCancellationToken token) const {
+                if (_cache == nullptr) {
+                    return _loop->submit(requests, options(), move(token), nullptr, _limiter);
+                }
+
+                vector<future<HttpResponse>> results(requests.size());
+                vector<HttpRequest> pending { };
+                vector<size_t> slots { };
+                for (size_t i = 0; i < requests.size(); ++i) {
+                    HttpRequest conditional { requests[i] };
+                    auto cached { _cache->lookup(conditional) };
+                    if (cached.has_value()) {
+                        promise<HttpResponse> ready { };
+                        ready.set_value(move(*cached));
+                        results[i] = ready.get_future();
+                    } else {
+                        pending.push_back(move(conditional));
+                        slots.push_back(i);
+                    }
+                }
+
+                auto queued { _loop->submit(move(pending), options(), move(token), _cache, _limiter) };
+                for (size_t i = 0; i < queued.size(); ++i) {
+                    results[slots[i]] = move(queued[i]);
+                }
+                return results;
             }
 
-            static HttpHeaders parseHeaders(const string& raw) {
-                HttpHeaders headers { };
+            HttpResponse perform(const HttpRequest& request, body_sink_t sink) const {
+                if (HttpTransfer::expired(request)) {
+                    throw HttpTransfer::deadlineExceeded();
+                }
+                if (_limiter == nullptr) {
+                    HttpTransfer transfer { _pool->acquire(request.url()), request, options(), move(sink) };
+                    return transfer.complete(curl_easy_perform(transfer.handle()));
+                }
 
-                istringstream stream { raw };
-                string line { };
+                string origin { request.origin() };
+                milliseconds delay { 0 };
+                for (size_t number = 1;; ++number) {
+                    auto response { attempt(request, sink, origin, number, delay) };
+                    if (response.has_value()) {
+                        return move(*response);
+                    }
+                    sleep_for(delay);
+                }
+            }
+
+            // One paced attempt: the response when it stands, or nullopt with 'delay' set to how
+            // long to back off before the next one. Only 2xx bodies reach 'sink', so an attempt
+            // that is retried has not passed anything on yet.
+            optional<HttpResponse> attempt(const HttpRequest& request, const body_sink_t& sink, const string& origin, size_t number, milliseconds& delay) const {
+                auto [wait, probe] = _limiter->reserve(origin);
+                optional<HttpTransfer> transfer { nullopt };
+                CURLcode code { CURLE_OK };
+                optional<HttpResponse> response { nullopt };
+                try {
+                    if (HttpTransfer::expired(request, wait)) {
+                        throw HttpTransfer::deadlineExceeded();
+                    }
+                    sleep_for(wait);
 
-                while (getline(stream, line)) {
-                    auto pos = line.find(':');
-                    if (pos != string::npos) {
-                        string key { line.substr(0, pos) };
-                        string value { line.substr(pos + 1) };
-                        key.erase(key.find_last_not_of(" \r\n") + 1);
-                        value.erase(0, value.find_first_not_of(" \t"));
-                        value.erase(value.find_last_not_of(" \r\n") + 1);
-                        headers.set(key, value);
+                    transfer.emplace(_pool->acquire(request.url()), request, options(), sink);
+                    code = curl_easy_perform(transfer->handle());
+                    if (!transfer->retryable(code)) {
+                        response = transfer->complete(code);
                     }
+                } catch (...) {
+                    // ended without an outcome to settle; a probe must not hold the circuit open
+                    _limiter->release(origin, probe);
+                    throw;
                 }
+                auto retry { _limiter->settle(origin, probe, response, number, delay) };
+                if (!retry.has_value() || HttpTransfer::expired(request, *retry)) {
+                    // without a response this rethrows the transport error
+                    return response.has_value() ? move(*response) : transfer->complete(code);
+                }
+                if (!response.has_value()) {
+                    transfer->abandon();
+                }
+                delay = *retry;
+                return nullopt;
+            }
 
-                return move(headers);
+            // A response from the cache, streamed to 'sink' like a downloaded one would be.
+            static HttpResponse deliver(HttpResponse response, const body_sink_t& sink) {
+                if (!sink || !response.isSuccess()) {
+                    return response;
+                }
+                sink(response.body());
+                return HttpResponse { response.status(), "", response.headers(), response.bodySize() };
             }
     };
 }
\ No newline at end of file
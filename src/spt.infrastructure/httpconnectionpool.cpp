@@ -0,0 +1,322 @@
+export module spt.infrastructure:httpconnectionpool;
+
+import <curl/curl.h>;
+
+import std;
+import :httprequest;
+import :httpresponse;
+
+namespace spt::infrastructure::net {
+    using std::array;
+    using std::condition_variable;
+    using std::enable_shared_from_this;
+    using std::invalid_argument;
+    using std::lock_guard;
+    using std::move;
+    using std::mutex;
+    using std::nullopt;
+    using std::optional;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::unique_lock;
+    using std::unordered_map;
+    using std::vector;
+
+    export struct HttpPoolStats {
+        size_t requests;
+        size_t handlesCreated;
+        size_t handlesReused;
+        size_t connectionsOpened;
+        size_t connectionsReused;
+        // new connections that set up TLS, resuming a shared session or with a full handshake;
+        // libcurl does not tell the two apart
+        size_t tlsConnections;
+        size_t http2Responses;
+        size_t bytesOnWire;
+        size_t bytesDecoded;
+    };
+
+    // Keeps libcurl easy handles alive between requests. A reused handle keeps its open
+    // connection, so the next request to the same host skips DNS, TCP and TLS; the DNS cache
+    // and TLS session tickets are additionally shared between all handles through a CURLSH, so
+    // even a new connection resumes the TLS session instead of doing a full handshake. Handles
+    // are parked per host and at most 'maxPerHost' requests to one host run at a time.
+    export class HttpConnectionPool final : public enable_shared_from_this<HttpConnectionPool> {
+        public:
+            // Checked-out easy handle, returned to the pool on destruction.
+            class Lease final {
+                private:
+                    shared_ptr<HttpConnectionPool> _pool;
+                    CURL* _handle;
+                    string _host;
+                    bool _reusable;
+
+                public:
+                    Lease(shared_ptr<HttpConnectionPool> pool, CURL* handle, string host)
+                        : _pool { move(pool) },
+                          _handle { handle },
+                          _host { move(host) },
+                          _reusable { true }
+                    {
+                    }
+
+                    Lease(Lease&& other) noexcept
+                        : _pool { move(other._pool) },
+                          _handle { other._handle },
+                          _host { move(other._host) },
+                          _reusable { other._reusable }
+                    {
+                        other._handle = nullptr;
+                    }
+
+                    Lease(const Lease&) = delete;
+                    Lease& operator=(const Lease&) = delete;
+                    Lease& operator=(Lease&&) = delete;
+
+                    ~Lease() {
+                        if (_handle != nullptr) {
+                            _pool->release(_host, _handle, _reusable);
+                        }
+                    }
+
+                    CURL* handle() const {
+                        return _handle;
+                    }
+
+                    const string& host() const {
+                        return _host;
+                    }
+
+                    // The handle is cleaned up instead of parked, e.g. after a transport error.
+                    void discard() {
+                        _reusable = false;
+                    }
+
+                    // Adds the transfer that just finished on the handle to the pool stats.
+                    void record(HttpBodySize bodySize) const {
+                        _pool->record(_handle, bodySize);
+                    }
+            };
+
+        private:
+            CURLSH* _share;
+            array<mutex, 8> _shareLocks;    // indexed by curl_lock_data
+            mutable mutex _mutex;
+            condition_variable _available;
+            unordered_map<string, vector<CURL*>> _idle;
+            unordered_map<string, size_t> _active;
+            size_t _idleCount;
+            size_t _maxPerHost;
+            size_t _maxIdle;
+            HttpPoolStats _stats;
+
+            static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+                auto* pool = static_cast<HttpConnectionPool*>(userptr);
+                pool->_shareLocks[static_cast<size_t>(data) % pool->_shareLocks.size()].lock();
+            }
+
+            static void unlockShare(CURL*, curl_lock_data data, void* userptr) {
+                auto* pool = static_cast<HttpConnectionPool*>(userptr);
+                pool->_shareLocks[static_cast<size_t>(data) % pool->_shareLocks.size()].unlock();
+            }
+
+            void release(const string& host, CURL* handle, bool reusable) {
+                CURL* evicted { nullptr };
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    --_active[host];
+                    if (reusable) {
+                        _idle[host].push_back(handle);
+                        ++_idleCount;
+                        if (_idleCount > _maxIdle) {
+                            evicted = evictOne(host);
+                        }
+                    } else {
+                        evicted = handle;
+                    }
+                }
+                _available.notify_all();
+
+                if (evicted != nullptr) {
+                    curl_easy_cleanup(evicted);
+                }
+            }
+
+            // Takes a slot for 'host' (the caller has checked the limit under 'lock') and
+            // prepares a parked or new handle for it.
+            Lease checkout(string host, unique_lock<mutex>& lock) {
+                ++_active[host];
+                ++_stats.requests;
+
+                CURL* handle { nullptr };
+                auto& parked { _idle[host] };
+                if (!parked.empty()) {
+                    handle = parked.back();
+                    parked.pop_back();
+                    --_idleCount;
+                    ++_stats.handlesReused;
+                } else {
+                    ++_stats.handlesCreated;
+                }
+                lock.unlock();
+
+                if (handle == nullptr) {
+                    handle = curl_easy_init();
+                    if (handle == nullptr) {
+                        lock.lock();
+                        --_active[host];
+                        lock.unlock();
+                        _available.notify_all();
+                        throw runtime_error { "Failed to initialize CURL" };
+                    }
+                } else {
+                    curl_easy_reset(handle);    // clears options, keeps the connection
+                }
+
+                curl_easy_setopt(handle, CURLOPT_SHARE, _share);
+                curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+                curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+                curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, 60L);
+                curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, 30L);
+                return Lease { shared_from_this(), handle, move(host) };
+            }
+
+            // Drops an idle handle, preferring hosts other than the one just used.
+            CURL* evictOne(const string& keep) {
+                for (auto& [host, handles] : _idle) {
+                    if (host != keep && !handles.empty()) {
+                        CURL* handle { handles.front() };
+                        handles.erase(handles.begin());
+                        --_idleCount;
+                        return handle;
+                    }
+                }
+                auto& handles { _idle[keep] };
+                CURL* handle { handles.front() };
+                handles.erase(handles.begin());
+                --_idleCount;
+                return handle;
+            }
+
+        public:
+            HttpConnectionPool()
+                : _share { curl_share_init() },
+                  _shareLocks { },
+                  _mutex { },
+                  _available { },
+                  _idle { },
+                  _active { },
+                  _idleCount { 0 },
+                  _maxPerHost { 6 },
+                  _maxIdle { 16 },
+                  _stats { }
+            {
+                if (_share == nullptr) {
+                    throw runtime_error { "Failed to initialize CURL share" };
+                }
+                curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, lockShare);
+                curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+                curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+                curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+                curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+                // connections stay with their easy handle: libcurl does not support a connection
+                // cache shared by transfers running concurrently on several threads
+            }
+
+            HttpConnectionPool(const HttpConnectionPool&) = delete;
+            HttpConnectionPool& operator=(const HttpConnectionPool&) = delete;
+
+            ~HttpConnectionPool() {
+                for (auto& [host, handles] : _idle) {
+                    for (auto* handle : handles) {
+                        curl_easy_cleanup(handle);
+                    }
+                }
+                curl_share_cleanup(_share);
+            }
+
+            size_t maxPerHost() const {
+                lock_guard<mutex> lock { _mutex };
+                return _maxPerHost;
+            }
+
+            void maxPerHost(size_t value) {
+                if (value == 0) {
+                    throw invalid_argument { "At least one connection per host is required" };
+                }
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    _maxPerHost = value;
+                }
+                _available.notify_all();
+            }
+
+            size_t maxIdle() const {
+                lock_guard<mutex> lock { _mutex };
+                return _maxIdle;
+            }
+
+            void maxIdle(size_t value) {
+                lock_guard<mutex> lock { _mutex };
+                _maxIdle = value;
+            }
+
+            HttpPoolStats stats() {
+                lock_guard<mutex> lock { _mutex };
+                return _stats;
+            }
+
+            // Hands out a handle for 'url', waiting while its host is at the limit. Parked
+            // handles for the same host are preferred because they hold a live connection.
+            Lease acquire(string_view url) {
+                string host { HttpRequest::originOf(url) };
+                unique_lock<mutex> lock { _mutex };
+                _available.wait(lock, [this, &host] {
+                    return _active[host] < _maxPerHost;
+                });
+                return checkout(move(host), lock);
+            }
+
+            // As acquire(), but returns nothing instead of waiting when the host is at the
+            // limit; used by the event loop, which must never block. With HTTP/2 each of the
+            // host's connections carries up to 'streamsPerConnection' requests at once.
+            optional<Lease> tryAcquire(string_view url, size_t streamsPerConnection = 1) {
+                string host { HttpRequest::originOf(url) };
+                unique_lock<mutex> lock { _mutex };
+                if (_active[host] >= _maxPerHost * streamsPerConnection) {
+                    return nullopt;
+                }
+                return checkout(move(host), lock);
+            }
+
+            // Counts whether the finished transfer on 'handle' opened a connection, and whether
+            // that set up TLS, or reused a kept-alive connection, whether it spoke HTTP/2 and how
+            // much compression saved.
+            void record(CURL* handle, HttpBodySize bodySize) {
+                long connects { 0L };
+                long version { 0L };
+                curl_off_t appConnect { 0 };
+                curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+                curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+                curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &version);
+
+                lock_guard<mutex> lock { _mutex };
+                _stats.bytesOnWire += bodySize.wire;
+                _stats.bytesDecoded += bodySize.decoded;
+                if (version == CURL_HTTP_VERSION_2_0) {
+                    ++_stats.http2Responses;
+                }
+                if (connects > 0) {
+                    _stats.connectionsOpened += static_cast<size_t>(connects);
+                    if (appConnect > 0) {
+                        ++_stats.tlsConnections;
+                    }
+                } else {
+                    ++_stats.connectionsReused;
+                }
+            }
+    };
+}
\ No newline at end of file
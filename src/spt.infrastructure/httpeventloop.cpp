@@ -0,0 +1,368 @@
+export module spt.infrastructure:httpeventloop;
+
+import <curl/curl.h>;
+
+import std;
+import :httpcache;
+import :httpconnectionpool;
+import :httpratelimiter;
+import :httprequest;
+import :httpresponse;
+import :httptransfer;
+
+namespace spt::infrastructure::net {
+    using std::atomic;
+    using std::current_exception;
+    using std::future;
+    using std::invalid_argument;
+    using std::jthread;
+    using std::lock_guard;
+    using std::make_exception_ptr;
+    using std::make_shared;
+    using std::make_unique;
+    using std::max;
+    using std::min;
+    using std::move;
+    using std::mutex;
+    using std::nullopt;
+    using std::optional;
+    using std::promise;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::stop_token;
+    using std::string;
+    using std::unique_ptr;
+    using std::unordered_map;
+    using std::vector;
+    using std::chrono::ceil;
+    using std::chrono::milliseconds;
+    using std::chrono::steady_clock;
+
+    // Lets the caller give up on requests it has already handed to the event loop. Copies share
+    // the same flag, so one token can cancel a whole batch.
+    export class HttpCancellationToken final {
+        private:
+            shared_ptr<atomic<bool>> _cancelled;
+
+        public:
+            HttpCancellationToken()
+                : _cancelled { make_shared<atomic<bool>>(false) }
+            {
+            }
+
+            void cancel() {
+                _cancelled->store(true);
+            }
+
+            bool cancelled() const {
+                return _cancelled->load();
+            }
+    };
+
+    // Runs transfers on one curl_multi handle from a single background thread, so any number
+    // of requests can be in flight without a thread each. The thread starts with the first
+    // request. Requests whose host is at the pool limit wait in submission order. HTTP/2
+    // requests to one origin are multiplexed as streams over the same connection. With a rate
+    // limiter, requests also wait for a token, and retries wait out their backoff in the queue.
+    export class HttpEventLoop final {
+        private:
+            struct Job {
+                HttpRequest request;
+                HttpTransferOptions options;
+                HttpCancellationToken token;
+                promise<HttpResponse> result;
+                shared_ptr<HttpCache> cache;
+                shared_ptr<HttpRateLimiter> limiter;
+                string origin;
+                size_t attempt;
+                size_t probe;           // the limiter's ticket while this attempt probes a circuit
+                milliseconds delay;     // the last retry backoff
+                steady_clock::time_point notBefore;
+                unique_ptr<HttpTransfer> transfer;
+            };
+
+            // how long the loop sleeps at most while requests are waiting or running, which is
+            // also how quickly it notices cancellations and freed pool slots
+            static constexpr int busyWaitMs { 100 };
+            static constexpr int idleWaitMs { 10000 };
+
+            shared_ptr<HttpConnectionPool> _pool;
+            CURLM* _multi;
+            atomic<size_t> _maxStreams;
+            mutex _mutex;
+            vector<unique_ptr<Job>> _submitted;
+            jthread _thread;
+
+            // owned by the loop thread
+            vector<unique_ptr<Job>> _waiting;
+            unordered_map<CURL*, unique_ptr<Job>> _running;
+            size_t _appliedStreams;
+            size_t _appliedPerHost;
+
+            static void fail(Job& job, runtime_error error) {
+                job.result.set_exception(make_exception_ptr(move(error)));
+            }
+
+            void run(stop_token stop) {
+                while (!stop.stop_requested()) {
+                    configure();
+                    int running { 0 };
+                    curl_multi_perform(_multi, &running);
+                    collectFinished();
+                    cancelRunning();
+
+                    // after collecting, so slots freed by finished transfers are reused at once;
+                    // a newly added handle makes the poll below return immediately
+                    {
+                        lock_guard<mutex> lock { _mutex };
+                        for (auto& job : _submitted) {
+                            _waiting.push_back(move(job));
+                        }
+                        _submitted.clear();
+                    }
+                    auto wait { startWaiting() };
+
+                    bool busy { !_waiting.empty() || !_running.empty() };
+                    curl_multi_poll(_multi, nullptr, 0, busy ? static_cast<int>(wait.count()) : idleWaitMs, nullptr);
+                }
+
+                lock_guard<mutex> lock { _mutex };
+                for (auto& job : _submitted) {
+                    _waiting.push_back(move(job));
+                }
+                _submitted.clear();
+                for (auto& job : _waiting) {
+                    fail(*job, runtime_error { "HTTP event loop stopped" });
+                }
+                _waiting.clear();
+                for (auto& [handle, job] : _running) {
+                    curl_multi_remove_handle(_multi, handle);
+                    job->transfer->abandon();
+                    if (job->limiter != nullptr) {
+                        job->limiter->release(job->origin, job->probe);
+                    }
+                    fail(*job, runtime_error { "HTTP event loop stopped" });
+                }
+                _running.clear();
+            }
+
+            // Multi options may only change between calls into the multi handle, so settings
+            // made from other threads are picked up here.
+            void configure() {
+                size_t streams { _maxStreams.load() };
+                if (streams != _appliedStreams) {
+                    curl_multi_setopt(_multi, CURLMOPT_MAX_CONCURRENT_STREAMS, static_cast<long>(streams));
+                    _appliedStreams = streams;
+                }
+                // caps connections, not requests: HTTP/1.1 falls back to queuing inside libcurl
+                size_t perHost { _pool->maxPerHost() };
+                if (perHost != _appliedPerHost) {
+                    curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(perHost));
+                    _appliedPerHost = perHost;
+                }
+            }
+
+            // Moves waiting jobs onto the multi handle as their host gets a free slot (and a
+            // token from the rate limiter), failing the ones that were cancelled or ran out of
+            // time while queued. Returns how long the loop may sleep before trying again.
+            milliseconds startWaiting() {
+                vector<unique_ptr<Job>> blocked { };
+                auto now { steady_clock::now() };
+                milliseconds next { busyWaitMs };
+                for (auto& job : _waiting) {
+                    if (job->token.cancelled()) {
+                        fail(*job, HttpTransfer::cancelled());
+                        continue;
+                    }
+                    if (HttpTransfer::expired(job->request)) {
+                        fail(*job, HttpTransfer::deadlineExceeded());
+                        continue;
+                    }
+
+                    try {
+                        // throws when the origin's circuit is open
+                        auto wait { job->notBefore - now };
+                        if (wait <= steady_clock::duration::zero() && job->limiter != nullptr) {
+                            wait = job->limiter->delay(job->origin);
+                        }
+                        if (wait > steady_clock::duration::zero()) {
+                            next = min(next, max(ceil<milliseconds>(wait), milliseconds { 1 }));
+                            blocked.push_back(move(job));
+                            continue;
+                        }
+
+                        size_t streams { job->options.version == HttpVersion::Http1 ? 1 : _appliedStreams };
+                        auto lease { _pool->tryAcquire(job->request.url(), streams) };
+                        if (!lease.has_value()) {
+                            blocked.push_back(move(job));
+                            continue;
+                        }
+                        if (job->limiter != nullptr) {
+                            job->probe = job->limiter->reserve(job->origin).probe;
+                            try {
+                                job->transfer = make_unique<HttpTransfer>(move(*lease), job->request, job->options, nullptr);
+                            } catch (...) {
+                                job->limiter->release(job->origin, job->probe);
+                                throw;
+                            }
+                        } else {
+                            job->transfer = make_unique<HttpTransfer>(move(*lease), job->request, job->options, nullptr);
+                        }
+                    } catch (...) {
+                        job->result.set_exception(current_exception());
+                        continue;
+                    }
+
+                    CURL* handle { job->transfer->handle() };
+                    curl_multi_add_handle(_multi, handle);
+                    _running.emplace(handle, move(job));
+                }
+                _waiting = move(blocked);
+                return next;
+            }
+
+            void collectFinished() {
+                int queued { 0 };
+                while (CURLMsg* message = curl_multi_info_read(_multi, &queued)) {
+                    if (message->msg != CURLMSG_DONE) {
+                        continue;
+                    }
+                    CURL* handle { message->easy_handle };
+                    CURLcode code { message->data.result };
+                    curl_multi_remove_handle(_multi, handle);
+
+                    auto node { _running.extract(handle) };
+                    if (node.empty()) {
+                        continue;
+                    }
+                    auto& job { *node.mapped() };
+                    bool settled { job.limiter == nullptr };
+                    try {
+                        optional<HttpResponse> response { nullopt };
+                        if (job.limiter == nullptr || !job.transfer->retryable(code)) {
+                            response = job.transfer->complete(code);
+                        }
+                        if (job.limiter != nullptr) {
+                            settled = true;
+                            auto retry { job.limiter->settle(job.origin, job.probe, response, job.attempt, job.delay) };
+                            if (retry.has_value() && !HttpTransfer::expired(job.request, *retry)) {
+                                if (!response.has_value()) {
+                                    job.transfer->abandon();
+                                }
+                                // the lease goes back to the pool while the job waits
+                                job.transfer.reset();
+                                ++job.attempt;
+                                job.delay = *retry;
+                                job.notBefore = steady_clock::now() + *retry;
+                                _waiting.push_back(move(node.mapped()));
+                                continue;
+                            }
+                            if (!response.has_value()) {
+                                response = job.transfer->complete(code);
+                            }
+                        }
+                        if (job.cache != nullptr) {
+                            response = job.cache->complete(job.request, move(*response));
+                            // a 304 for an entry evicted in the meantime; ask again unconditionally
+                            if (response->status() == 304 && HttpCache::unconditional(job.request)) {
+                                job.transfer.reset();
+                                job.notBefore = steady_clock::now();
+                                _waiting.push_back(move(node.mapped()));
+                                continue;
+                            }
+                        }
+                        job.result.set_value(move(*response));
+                    } catch (...) {
+                        if (!settled) {
+                            job.limiter->release(job.origin, job.probe);
+                        }
+                        job.result.set_exception(current_exception());
+                    }
+                    // the lease goes back to the pool as the job is destroyed here
+                }
+            }
+
+            void cancelRunning() {
+                for (auto it = _running.begin(); it != _running.end();) {
+                    auto& job { *it->second };
+                    if (!job.token.cancelled()) {
+                        ++it;
+                        continue;
+                    }
+                    curl_multi_remove_handle(_multi, it->first);
+                    job.transfer->abandon();
+                    if (job.limiter != nullptr) {
+                        job.limiter->release(job.origin, job.probe);
+                    }
+                    fail(job, HttpTransfer::cancelled());
+                    it = _running.erase(it);
+                }
+            }
+
+        public:
+            explicit HttpEventLoop(shared_ptr<HttpConnectionPool> pool)
+                : _pool { move(pool) },
+                  _multi { curl_multi_init() },
+                  _maxStreams { 100 },
+                  _mutex { },
+                  _submitted { },
+                  _thread { },
+                  _waiting { },
+                  _running { },
+                  _appliedStreams { 0 },
+                  _appliedPerHost { 0 }
+            {
+                if (_multi == nullptr) {
+                    throw runtime_error { "Failed to initialize CURL multi" };
+                }
+                curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+            }
+
+            HttpEventLoop(const HttpEventLoop&) = delete;
+            HttpEventLoop& operator=(const HttpEventLoop&) = delete;
+
+            ~HttpEventLoop() {
+                if (_thread.joinable()) {
+                    _thread.request_stop();
+                    curl_multi_wakeup(_multi);
+                    _thread.join();
+                }
+                curl_multi_cleanup(_multi);
+            }
+
+            size_t maxConcurrentStreams() const {
+                return _maxStreams.load();
+            }
+
+            void maxConcurrentStreams(size_t value) {
+                if (value == 0) {
+                    throw invalid_argument { "At least one stream per connection is required" };
+                }
+                _maxStreams.store(value);
+                curl_multi_wakeup(_multi);
+            }
+
+            // Responses are passed through 'cache' (when given) before they are handed out, and
+            // attempts are paced and retried by 'limiter' (when given).
+            vector<future<HttpResponse>> submit(vector<HttpRequest> requests, const HttpTransferOptions& options, HttpCancellationToken token, shared_ptr<HttpCache> cache, shared_ptr<HttpRateLimiter> limiter) {
+                vector<future<HttpResponse>> results { };
+                results.reserve(requests.size());
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    auto now { steady_clock::now() };
+                    for (auto& request : requests) {
+                        string origin { request.origin() };
+                        auto job { make_unique<Job>(move(request), options, token, promise<HttpResponse> { }, cache, limiter, move(origin), 1, 0, milliseconds { 0 }, now, nullptr) };
+                        results.push_back(job->result.get_future());
+                        _submitted.push_back(move(job));
+                    }
+                    if (!_thread.joinable()) {
+                        _thread = jthread { [this](stop_token stop) { run(stop); } };
+                    }
+                }
+                curl_multi_wakeup(_multi);
+                return results;
+            }
+    };
+}
\ No newline at end of file
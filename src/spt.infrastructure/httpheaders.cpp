@@ -3,52 +3,317 @@ export module spt.infrastructure:httpheaders;
 import std;
 
 namespace spt::infrastructure::net {
-    using std::map;
+    using std::array;
+    using std::errc;
+    using std::from_chars;
+    using std::move;
     using std::nullopt;
     using std::optional;
+    using std::pair;
+    using std::size_t;
     using std::string;
     using std::string_view;
+    using std::tolower;
+    using std::uint32_t;
+    using std::uint8_t;
+    using std::vector;
+    using std::chrono::day;
+    using std::chrono::hours;
+    using std::chrono::minutes;
+    using std::chrono::month;
+    using std::chrono::seconds;
+    using std::chrono::sys_days;
+    using std::chrono::sys_seconds;
+    using std::chrono::year;
+    using std::chrono::year_month_day;
 
+    // Header fields in arrival order, names matched case-insensitively (HTTP/2 sends them in
+    // lower case). Names and values share one text buffer and fields refer to it by offset, so
+    // a response's headers take two allocations however many there are. Common names are not
+    // stored at all: the field points into a table of their canonical spelling, and looking
+    // one of them up compares table indexes instead of text.
     export class HttpHeaders final {
+        private:
+            static constexpr array<string_view, 24> commonNames {
+                "Accept", "Accept-Encoding", "Age", "Alt-Svc", "Cache-Control", "Connection",
+                "Content-Encoding", "Content-Length", "Content-Type", "Date", "ETag", "Expires",
+                "If-Modified-Since", "If-None-Match", "Last-Modified", "Location", "Retry-After",
+                "Server", "Set-Cookie", "Strict-Transport-Security", "Transfer-Encoding",
+                "User-Agent", "Vary", "X-Cache"
+            };
+            static constexpr uint8_t uncommon { 0xFF };
+
+            struct Field {
+                uint8_t common;         // index into commonNames, or 'uncommon'
+                uint32_t name;          // offset into _text when uncommon
+                uint32_t nameLength;
+                uint32_t value;
+                uint32_t valueLength;
+                uint32_t valueCapacity; // bytes reserved at 'value' for later values of the field
+            };
+
+            string _text;
+            vector<Field> _fields;
+            size_t _unused;             // bytes of _text left behind by replaced values
+
+            static uint8_t commonIndex(string_view name) {
+                for (size_t i = 0; i < commonNames.size(); ++i) {
+                    if (equalsIgnoreCase(commonNames[i], name)) {
+                        return static_cast<uint8_t>(i);
+                    }
+                }
+                return uncommon;
+            }
+
+            static string_view trim(string_view text) {
+                auto first { text.find_first_not_of(" \t\r\n") };
+                if (first == string_view::npos) {
+                    return { };
+                }
+                return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+            }
+
+            string_view nameOf(const Field& field) const {
+                if (field.common != uncommon) {
+                    return commonNames[field.common];
+                }
+                return string_view { _text }.substr(field.name, field.nameLength);
+            }
+
+            string_view valueOf(const Field& field) const {
+                return string_view { _text }.substr(field.value, field.valueLength);
+            }
+
+            const Field* fieldOf(string_view name) const {
+                uint8_t common { commonIndex(name) };
+                for (const auto& field : _fields) {
+                    if (common != uncommon ? field.common == common : field.common == uncommon && equalsIgnoreCase(nameOf(field), name)) {
+                        return &field;
+                    }
+                }
+                return nullptr;
+            }
+
+            uint32_t store(string_view text) {
+                auto offset { static_cast<uint32_t>(_text.size()) };
+                _text.append(text);
+                return offset;
+            }
+
+            // Copies the live names and values into a fresh buffer, dropping replaced values.
+            void compact() {
+                string text { };
+                text.reserve(_text.size() - _unused);
+                for (auto& field : _fields) {
+                    if (field.common == uncommon) {
+                        auto name { static_cast<uint32_t>(text.size()) };
+                        text.append(_text, field.name, field.nameLength);
+                        field.name = name;
+                    }
+                    auto value { static_cast<uint32_t>(text.size()) };
+                    text.append(_text, field.value, field.valueLength);
+                    field.value = value;
+                    field.valueCapacity = field.valueLength;
+                }
+                _text = move(text);
+                _unused = 0;
+            }
+
         public:
-            using iterator = map<string, string>::iterator;
-            using const_iterator = map<string, string>::const_iterator;
+            HttpHeaders()
+                : _text { },
+                  _fields { },
+                  _unused { 0 }
+            {
+            }
+
+            class const_iterator final {
+                private:
+                    const HttpHeaders* _headers;
+                    vector<Field>::const_iterator _field;
+
+                public:
+                    const_iterator(const HttpHeaders* headers, vector<Field>::const_iterator field)
+                        : _headers { headers },
+                          _field { field }
+                    {
+                    }
 
-            bool contains(const string& key) const {
-                return _headers.contains(key);
+                    pair<string_view, string_view> operator*() const {
+                        return { _headers->nameOf(*_field), _headers->valueOf(*_field) };
+                    }
+
+                    const_iterator& operator++() {
+                        ++_field;
+                        return *this;
+                    }
+
+                    bool operator==(const const_iterator& other) const {
+                        return _field == other._field;
+                    }
+            };
+
+            static bool equalsIgnoreCase(string_view left, string_view right) {
+                if (left.size() != right.size()) {
+                    return false;
+                }
+                for (size_t i = 0; i < left.size(); ++i) {
+                    if (tolower(static_cast<unsigned char>(left[i])) != tolower(static_cast<unsigned char>(right[i]))) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool contains(string_view name) const {
+                return fieldOf(name) != nullptr;
             }
 
-            optional<string> get(const string& key) const {
-                optional<string> result { nullopt };
-                auto it = _headers.find(key);
-                if (it != _headers.end()) {
-                    result = it->second;
+            // The view stays valid until the headers are changed or destroyed.
+            optional<string_view> get(string_view name) const {
+                const Field* field { fieldOf(name) };
+                if (field == nullptr) {
+                    return nullopt;
                 }
+                return valueOf(*field);
+            }
 
-                return result;
+            // Replaces the value of a field that is already there, keeping its spelling. A value
+            // that fits where the old one was is written over it; otherwise it is appended, and
+            // the buffer is compacted once replaced values take up more than half of it.
+            void set(string_view name, string_view value) {
+                const Field* existing { fieldOf(name) };
+                if (existing != nullptr) {
+                    auto& field { _fields[static_cast<size_t>(existing - _fields.data())] };
+                    if (value.size() <= field.valueCapacity) {
+                        _text.replace(field.value, value.size(), value);
+                        field.valueLength = static_cast<uint32_t>(value.size());
+                        return;
+                    }
+                    _unused += field.valueCapacity;
+                    field.valueLength = static_cast<uint32_t>(value.size());
+                    field.valueCapacity = field.valueLength;
+                    field.value = store(value);
+                    if (_unused > _text.size() / 2) {
+                        compact();
+                    }
+                    return;
+                }
+                auto length { static_cast<uint32_t>(value.size()) };
+                Field field { commonIndex(name), 0, 0, 0, length, length };
+                if (field.common == uncommon) {
+                    field.nameLength = static_cast<uint32_t>(name.size());
+                    field.name = store(name);
+                }
+                field.value = store(value);
+                if (_fields.empty()) {
+                    _fields.reserve(16);
+                    _text.reserve(512);
+                }
+                _fields.push_back(field);
             }
 
-            void set(const string& key, const string& value) {
-                _headers[key] = value;
+            // Returns whether the field was there.
+            bool remove(string_view name) {
+                const Field* existing { fieldOf(name) };
+                if (existing == nullptr) {
+                    return false;
+                }
+                _unused += existing->valueCapacity + (existing->common == uncommon ? existing->nameLength : 0);
+                _fields.erase(_fields.begin() + (existing - _fields.data()));
+                if (_unused > _text.size() / 2) {
+                    compact();
+                }
+                return true;
             }
 
-            iterator begin() {
-                return _headers.begin();
+            // Adds one "Name: value" line as it arrives from the server, trailing CRLF included;
+            // returns false for anything else, such as the status line. A field sent on several
+            // lines is combined into one comma-separated value, as HTTP allows, so nothing on
+            // an earlier line is lost; Set-Cookie cannot be combined and keeps its last line.
+            bool parse(string_view line) {
+                auto colon { line.find(':') };
+                if (colon == string_view::npos || colon == 0 || line.starts_with("HTTP/")) {
+                    return false;
+                }
+                string_view name { trim(line.substr(0, colon)) };
+                string_view value { trim(line.substr(colon + 1)) };
+                auto existing { get(name) };
+                if (existing.has_value() && !equalsIgnoreCase(name, "Set-Cookie")) {
+                    string combined { *existing };
+                    if (!combined.empty() && !value.empty()) {
+                        combined += ", ";
+                    }
+                    combined += value;
+                    set(name, combined);
+                    return true;
+                }
+                set(name, value);
+                return true;
+            }
+
+            void clear() {
+                _text.clear();
+                _fields.clear();
+                _unused = 0;
+            }
+
+            size_t size() const {
+                return _fields.size();
             }
 
-            iterator end() {
-                return _headers.end();
+            bool empty() const {
+                return _fields.empty();
             }
 
             const_iterator begin() const {
-                return _headers.begin();
+                return const_iterator { this, _fields.begin() };
             }
 
             const_iterator end() const {
-                return _headers.end();
+                return const_iterator { this, _fields.end() };
             }
 
-        private:
-            map<string, string> _headers;
+            // IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT"), the only format servers may send
+            // in Date, Expires, Last-Modified or Retry-After.
+            static optional<sys_seconds> parseDate(string_view text) {
+                static constexpr array<string_view, 12> months {
+                    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+                };
+                text = trim(text);
+                if (text.size() != 29 || text[3] != ',' || text.substr(26) != "GMT") {
+                    return nullopt;
+                }
+                auto number = [&text](size_t position, size_t length) -> optional<int> {
+                    int value { 0 };
+                    const char* begin { text.data() + position };
+                    auto [end, ec] = from_chars(begin, begin + length, value);
+                    if (ec != errc { } || end != begin + length) {
+                        return nullopt;
+                    }
+                    return value;
+                };
+                auto dayOfMonth { number(5, 2) };
+                auto yearNumber { number(12, 4) };
+                auto hour { number(17, 2) };
+                auto minute { number(20, 2) };
+                auto second { number(23, 2) };
+                size_t monthIndex { 0 };
+                while (monthIndex < months.size() && months[monthIndex] != text.substr(8, 3)) {
+                    ++monthIndex;
+                }
+                if (!dayOfMonth || !yearNumber || !hour || !minute || !second || monthIndex == months.size()) {
+                    return nullopt;
+                }
+                year_month_day date {
+                    year { *yearNumber },
+                    month { static_cast<unsigned>(monthIndex + 1) },
+                    day { static_cast<unsigned>(*dayOfMonth) }
+                };
+                if (!date.ok()) {
+                    return nullopt;
+                }
+                return sys_seconds { sys_days { date } } + hours { *hour } + minutes { *minute } + seconds { *second };
+            }
     };
 }
\ No newline at end of file
@@ -0,0 +1,292 @@
+export module spt.infrastructure:httpmetrics;
+
+import std;
+import :httprequest;
+import :httpresponse;
+import :jsonwriter;
+
+namespace spt::infrastructure::net {
+    using std::array;
+    using std::atomic;
+    using std::bit_width;
+    using std::ceil;
+    using std::format;
+    using std::invalid_argument;
+    using std::ios;
+    using std::less;
+    using std::lock_guard;
+    using std::make_unique;
+    using std::map;
+    using std::memory_order_relaxed;
+    using std::min;
+    using std::ofstream;
+    using std::pair;
+    using std::runtime_error;
+    using std::shared_lock;
+    using std::shared_mutex;
+    using std::size_t;
+    using std::streamsize;
+    using std::string;
+    using std::string_view;
+    using std::uint64_t;
+    using std::unique_ptr;
+    using std::vector;
+    using std::filesystem::path;
+    using spt::infrastructure::text::JsonWriter;
+
+    // Counts values in HDR-style log-linear buckets: exactly below 64, then 32 buckets per power
+    // of two, so any percentile is within about 3 % of the true value. Values are recorded with
+    // relaxed atomic increments and no lock; reading while others record sees a close snapshot.
+    export class HttpHistogram final {
+        private:
+            static constexpr unsigned subBits { 6 };
+            static constexpr size_t subCount { size_t { 1 } << subBits };
+            static constexpr size_t halfCount { subCount / 2 };
+            // values needing more bits than this (12 days in microseconds) share the last bucket
+            static constexpr unsigned valueBits { 40 };
+            static constexpr size_t bucketCount { subCount + (valueBits - subBits) * halfCount };
+
+            array<atomic<uint64_t>, bucketCount> _buckets;
+            atomic<uint64_t> _count;
+            atomic<uint64_t> _sum;
+            atomic<uint64_t> _max;
+
+            static size_t indexOf(uint64_t value) {
+                if (value < subCount) {
+                    return static_cast<size_t>(value);
+                }
+                unsigned shift { static_cast<unsigned>(bit_width(value)) - subBits };
+                if (shift > valueBits - subBits) {
+                    return bucketCount - 1;
+                }
+                return subCount + (shift - 1) * halfCount + static_cast<size_t>((value >> shift) - halfCount);
+            }
+
+            // The largest value counted in bucket 'index'.
+            static uint64_t valueOf(size_t index) {
+                if (index < subCount) {
+                    return index;
+                }
+                size_t shift { (index - subCount) / halfCount + 1 };
+                uint64_t sub { (index - subCount) % halfCount + halfCount };
+                return ((sub + 1) << shift) - 1;
+            }
+
+        public:
+            HttpHistogram()
+                : _buckets { },
+                  _count { 0 },
+                  _sum { 0 },
+                  _max { 0 }
+            {
+            }
+
+            HttpHistogram(const HttpHistogram&) = delete;
+            HttpHistogram& operator=(const HttpHistogram&) = delete;
+
+            void record(uint64_t value) {
+                _buckets[indexOf(value)].fetch_add(1, memory_order_relaxed);
+                _count.fetch_add(1, memory_order_relaxed);
+                _sum.fetch_add(value, memory_order_relaxed);
+                uint64_t highest { _max.load(memory_order_relaxed) };
+                while (value > highest && !_max.compare_exchange_weak(highest, value, memory_order_relaxed)) {
+                }
+            }
+
+            uint64_t count() const {
+                return _count.load(memory_order_relaxed);
+            }
+
+            uint64_t max() const {
+                return _max.load(memory_order_relaxed);
+            }
+
+            double mean() const {
+                uint64_t count { this->count() };
+                return count == 0 ? 0.0 : static_cast<double>(_sum.load(memory_order_relaxed)) / static_cast<double>(count);
+            }
+
+            // The value 'percent' of all recorded values are at or below, e.g. 99.0 for p99.
+            uint64_t percentile(double percent) const {
+                if (percent < 0.0 || percent > 100.0) {
+                    throw invalid_argument { "A percentile lies between 0 and 100" };
+                }
+                uint64_t count { this->count() };
+                if (count == 0) {
+                    return 0;
+                }
+                uint64_t rank { static_cast<uint64_t>(ceil(percent / 100.0 * static_cast<double>(count))) };
+                rank = rank == 0 ? 1 : rank;
+                uint64_t seen { 0 };
+                for (size_t i = 0; i < bucketCount; ++i) {
+                    seen += _buckets[i].load(memory_order_relaxed);
+                    if (seen >= rank) {
+                        return min(valueOf(i), max());
+                    }
+                }
+                return max();
+            }
+    };
+
+    export enum class HttpPhase {
+        NameLookup,
+        Connect,
+        Tls,
+        PreTransfer,
+        Server,
+        Transfer,
+        Total
+    };
+
+    // Histograms of one endpoint's requests: each phase in microseconds, and bytes on the wire.
+    export class HttpEndpointMetrics final {
+        private:
+            array<HttpHistogram, 7> _phases;
+            HttpHistogram _bytes;
+
+        public:
+            HttpEndpointMetrics()
+                : _phases { },
+                  _bytes { }
+            {
+            }
+
+            void record(const HttpTimings& timings, size_t bytes) {
+                for (auto [phase, time] : {
+                    pair { HttpPhase::NameLookup, timings.nameLookup },
+                    pair { HttpPhase::Connect, timings.connect },
+                    pair { HttpPhase::Tls, timings.tls },
+                    pair { HttpPhase::PreTransfer, timings.preTransfer },
+                    pair { HttpPhase::Server, timings.server },
+                    pair { HttpPhase::Transfer, timings.transfer },
+                    pair { HttpPhase::Total, timings.total }
+                }) {
+                    _phases[static_cast<size_t>(phase)].record(static_cast<uint64_t>(time.count()));
+                }
+                _bytes.record(bytes);
+            }
+
+            const HttpHistogram& phase(HttpPhase phase) const {
+                return _phases[static_cast<size_t>(phase)];
+            }
+
+            const HttpHistogram& bytes() const {
+                return _bytes;
+            }
+    };
+
+    // Timing histograms per endpoint, for every response a client with the metrics attached
+    // receives from the network. An endpoint is the origin and the path without its last
+    // segment, so "https://host/v8/finance/chart/MSFT?range=1d" counts towards
+    // "https://host/v8/finance/chart" along with every other symbol.
+    export class HttpMetrics final {
+        private:
+            mutable shared_mutex _mutex;
+            map<string, unique_ptr<HttpEndpointMetrics>, less<>> _endpoints;
+
+            static constexpr array<double, 3> percentiles { 50.0, 90.0, 99.0 };
+            static constexpr array<string_view, 7> phaseNames { "nameLookup", "connect", "tls", "preTransfer", "server", "transfer", "total" };
+
+            static void writeHistogram(JsonWriter& writer, const HttpHistogram& histogram) {
+                writer.onStartObject();
+                for (double percent : percentiles) {
+                    writer.onKey(format("p{0}", percent));
+                    writer.onNumber(static_cast<double>(histogram.percentile(percent)));
+                }
+                writer.onKey("max");
+                writer.onNumber(static_cast<double>(histogram.max()));
+                writer.onKey("mean");
+                writer.onNumber(histogram.mean());
+                writer.onEndObject();
+            }
+
+        public:
+            HttpMetrics()
+                : _mutex { },
+                  _endpoints { }
+            {
+            }
+
+            HttpMetrics(const HttpMetrics&) = delete;
+            HttpMetrics& operator=(const HttpMetrics&) = delete;
+
+            static string endpointOf(string_view url) {
+                string origin { HttpRequest::originOf(url) };
+                string_view rest { url.substr(origin.size()) };
+                rest = rest.substr(0, rest.find_first_of("?#"));
+                size_t last { rest.rfind('/') };
+                return origin + string { rest.substr(0, last == string_view::npos ? 0 : last) };
+            }
+
+            // Only the first request to an endpoint takes the lock exclusively.
+            void record(string_view url, const HttpTimings& timings, size_t bytes) {
+                string endpoint { endpointOf(url) };
+                HttpEndpointMetrics* metrics { nullptr };
+                {
+                    shared_lock<shared_mutex> lock { _mutex };
+                    auto found { _endpoints.find(endpoint) };
+                    if (found != _endpoints.end()) {
+                        metrics = found->second.get();
+                    }
+                }
+                if (metrics == nullptr) {
+                    lock_guard<shared_mutex> lock { _mutex };
+                    auto& slot { _endpoints[endpoint] };
+                    if (slot == nullptr) {
+                        slot = make_unique<HttpEndpointMetrics>();
+                    }
+                    metrics = slot.get();
+                }
+                // endpoints are never removed, so the histograms outlive the lock
+                metrics->record(timings, bytes);
+            }
+
+            vector<string> endpoints() const {
+                shared_lock<shared_mutex> lock { _mutex };
+                vector<string> result { };
+                for (const auto& [endpoint, metrics] : _endpoints) {
+                    result.push_back(endpoint);
+                }
+                return result;
+            }
+
+            const HttpEndpointMetrics& endpoint(string_view endpoint) const {
+                shared_lock<shared_mutex> lock { _mutex };
+                auto found { _endpoints.find(endpoint) };
+                if (found == _endpoints.end()) {
+                    throw invalid_argument { format("No requests recorded for {0}", endpoint) };
+                }
+                return *found->second;
+            }
+
+            // Writes p50, p90, p99, max and mean of every phase (in microseconds) and of the
+            // bytes on the wire, per endpoint, as a JSON object keyed by endpoint.
+            void save(const path& file) const {
+                ofstream stream { file, ios::binary };
+                if (!stream) {
+                    throw runtime_error { "Failed to create metrics file " + file.string() };
+                }
+                JsonWriter writer { [&stream](string_view chunk) {
+                    stream.write(chunk.data(), static_cast<streamsize>(chunk.size()));
+                } };
+
+                shared_lock<shared_mutex> lock { _mutex };
+                writer.onStartObject();
+                for (const auto& [endpoint, metrics] : _endpoints) {
+                    writer.onKey(endpoint);
+                    writer.onStartObject();
+                    writer.onKey("requests");
+                    writer.onNumber(static_cast<double>(metrics->bytes().count()));
+                    for (size_t i = 0; i < phaseNames.size(); ++i) {
+                        writer.onKey(phaseNames[i]);
+                        writeHistogram(writer, metrics->phase(static_cast<HttpPhase>(i)));
+                    }
+                    writer.onKey("bytes");
+                    writeHistogram(writer, metrics->bytes());
+                    writer.onEndObject();
+                }
+                writer.onEndObject();
+                writer.flush();
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,314 @@
+export module spt.infrastructure:httpratelimiter;
+
+import std;
+import :httpheaders;
+import :httpresponse;
+
+namespace spt::infrastructure::net {
+    using std::errc;
+    using std::format;
+    using std::from_chars;
+    using std::invalid_argument;
+    using std::lock_guard;
+    using std::max;
+    using std::min;
+    using std::mt19937_64;
+    using std::mutex;
+    using std::nullopt;
+    using std::optional;
+    using std::random_device;
+    using std::runtime_error;
+    using std::size_t;
+    using std::string;
+    using std::uniform_int_distribution;
+    using std::unordered_map;
+    using std::chrono::ceil;
+    using std::chrono::duration;
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    using std::chrono::seconds;
+    using std::chrono::steady_clock;
+    using std::chrono::system_clock;
+
+    export struct HttpRateLimiterStats {
+        size_t throttled;       // 429 and 503 responses
+        size_t retries;
+        size_t retriesDenied;   // retries refused because the budget ran out
+        size_t rejected;        // requests failed fast by an open circuit or a long pause
+        size_t circuitsOpened;
+    };
+
+    export struct HttpRetryPolicy {
+        size_t maxAttempts;         // the first one included, 1 disables retries
+        milliseconds baseDelay;
+        milliseconds maxDelay;
+        milliseconds maxRetryAfter; // a server asking for a longer pause is not retried
+        double budgetRatio;         // retries earned per successful response
+        double budgetReserve;       // retries available at start, and the most ever saved up
+    };
+
+    export struct HttpCircuitPolicy {
+        size_t failureThreshold;    // consecutive failures that open the circuit
+        milliseconds openFor;       // before a single probe request is let through
+    };
+
+    // What reserve() grants a request: how long to wait before sending it, and its ticket when
+    // it is the probe of an open circuit, to hand back to release() or settle().
+    export struct HttpReservation {
+        steady_clock::duration wait;
+        size_t probe;               // 0 for any other request
+    };
+
+    // Keeps the requests to each origin within what the server tolerates. A token bucket per
+    // origin paces them, a Retry-After pauses the origin as a whole, and failed attempts are
+    // retried after a decorrelated jittered backoff while a budget shared by all origins has
+    // retries left, so an outage cannot multiply the load. After consecutive failures an
+    // origin's circuit opens and its requests fail at once until a probe succeeds again.
+    export class HttpRateLimiter final {
+        private:
+            struct Origin {
+                double tokens;
+                steady_clock::time_point refilled;
+                steady_clock::time_point pausedUntil;
+                size_t failures;
+                optional<steady_clock::time_point> openUntil;
+                size_t probe;       // ticket of the probe in flight, 0 when there is none
+            };
+
+            mutable mutex _mutex;
+            double _rate;
+            double _burst;
+            HttpRetryPolicy _retryPolicy;
+            HttpCircuitPolicy _circuitPolicy;
+            unordered_map<string, Origin> _origins;
+            size_t _probes;
+            double _budget;
+            mt19937_64 _random;
+            HttpRateLimiterStats _stats;
+
+            Origin& originOf(const string& origin, steady_clock::time_point now) {
+                auto [it, added] = _origins.try_emplace(origin, Origin { _burst, now, now, 0, nullopt, 0 });
+                Origin& state { it->second };
+                duration<double> elapsed { now - state.refilled };
+                state.tokens = min(_burst, state.tokens + elapsed.count() * _rate);
+                state.refilled = now;
+                return state;
+            }
+
+            // How long a request to 'state' has to wait, throwing while its circuit is open or
+            // the server asked for a longer pause than a request is allowed to wait.
+            steady_clock::duration waitFor(const string& origin, const Origin& state, steady_clock::time_point now) {
+                if (state.openUntil.has_value() && (now < *state.openUntil || state.probe != 0)) {
+                    ++_stats.rejected;
+                    auto left { ceil<milliseconds>(max(*state.openUntil - now, steady_clock::duration::zero())) };
+                    throw runtime_error {
+                        format("Circuit open for {0} after repeated failures, retrying in {1} ms", origin, left.count())
+                    };
+                }
+                steady_clock::duration wait { max(state.pausedUntil - now, steady_clock::duration::zero()) };
+                if (wait > _retryPolicy.maxRetryAfter) {
+                    ++_stats.rejected;
+                    throw runtime_error {
+                        format("{0} asked for a pause of another {1} s", origin, ceil<seconds>(wait).count())
+                    };
+                }
+                if (state.tokens < 1.0) {
+                    wait = max(wait, duration_cast<steady_clock::duration>(duration<double> { (1.0 - state.tokens) / _rate }));
+                }
+                return wait;
+            }
+
+            // While the circuit is open only its probe decides whether it closes or stays open;
+            // requests reserved before it opened may still end in the meantime.
+            static bool decides(const Origin& state, size_t probe) {
+                return !state.openUntil.has_value() || (probe != 0 && probe == state.probe);
+            }
+
+            void succeeded(Origin& state, size_t probe) {
+                _budget = min(_retryPolicy.budgetReserve, _budget + _retryPolicy.budgetRatio);
+                if (!decides(state, probe)) {
+                    return;
+                }
+                state.failures = 0;
+                state.openUntil = nullopt;
+                state.probe = 0;
+            }
+
+            void failed(Origin& state, size_t probe, steady_clock::time_point now) {
+                if (!decides(state, probe)) {
+                    return;
+                }
+                ++state.failures;
+                if (state.probe != 0 || state.failures >= _circuitPolicy.failureThreshold) {
+                    state.openUntil = now + _circuitPolicy.openFor;
+                    state.probe = 0;
+                    ++_stats.circuitsOpened;
+                }
+            }
+
+            // Decorrelated jitter: a random delay between the base and three times the previous
+            // one, so retries from many requests spread out instead of arriving in waves.
+            milliseconds backoff(milliseconds previous) {
+                auto low { _retryPolicy.baseDelay.count() };
+                auto high { max(low, min(_retryPolicy.maxDelay.count(), previous.count() * 3)) };
+                return milliseconds { uniform_int_distribution<milliseconds::rep> { low, high }(_random) };
+            }
+
+            // Retry-After as delay-seconds or an HTTP date.
+            static optional<milliseconds> retryAfterOf(const HttpResponse& response) {
+                auto value { response.headers().get("Retry-After") };
+                if (!value.has_value()) {
+                    return nullopt;
+                }
+                long long delay { 0 };
+                auto [end, ec] = from_chars(value->data(), value->data() + value->size(), delay);
+                if (ec == errc { } && end == value->data() + value->size() && delay >= 0) {
+                    return seconds { delay };
+                }
+                auto date { HttpHeaders::parseDate(*value) };
+                if (!date.has_value()) {
+                    return nullopt;
+                }
+                return max(duration_cast<milliseconds>(*date - system_clock::now()), milliseconds { 0 });
+            }
+
+        public:
+            // 'rate' requests per second to each origin on average, in bursts of up to 'burst'.
+            HttpRateLimiter(double rate = 10.0, double burst = 20.0)
+                : _mutex { },
+                  _rate { rate },
+                  _burst { burst },
+                  _retryPolicy { 4, milliseconds { 250 }, seconds { 10 }, seconds { 30 }, 0.2, 10.0 },
+                  _circuitPolicy { 5, seconds { 30 } },
+                  _origins { },
+                  _probes { 0 },
+                  _budget { 10.0 },
+                  _random { random_device { }() },
+                  _stats { }
+            {
+                if (rate <= 0.0 || burst < 1.0) {
+                    throw invalid_argument {
+                        format("Invalid rate limit of {0} requests per second in bursts of {1}", rate, burst)
+                    };
+                }
+            }
+
+            HttpRateLimiter(const HttpRateLimiter&) = delete;
+            HttpRateLimiter& operator=(const HttpRateLimiter&) = delete;
+
+            HttpRetryPolicy retryPolicy() const {
+                lock_guard<mutex> lock { _mutex };
+                return _retryPolicy;
+            }
+
+            void retryPolicy(HttpRetryPolicy value) {
+                if (value.maxAttempts == 0 || value.baseDelay.count() <= 0 || value.maxDelay < value.baseDelay) {
+                    throw invalid_argument { "Invalid retry policy" };
+                }
+                lock_guard<mutex> lock { _mutex };
+                _retryPolicy = value;
+                _budget = min(_budget, value.budgetReserve);
+            }
+
+            HttpCircuitPolicy circuitPolicy() const {
+                lock_guard<mutex> lock { _mutex };
+                return _circuitPolicy;
+            }
+
+            void circuitPolicy(HttpCircuitPolicy value) {
+                if (value.failureThreshold == 0) {
+                    throw invalid_argument { "A circuit needs at least one failure to open" };
+                }
+                lock_guard<mutex> lock { _mutex };
+                _circuitPolicy = value;
+            }
+
+            HttpRateLimiterStats stats() const {
+                lock_guard<mutex> lock { _mutex };
+                return _stats;
+            }
+
+            // How long a request to 'origin' would have to wait right now, without taking a
+            // token; throws while the origin's circuit is open.
+            steady_clock::duration delay(const string& origin) {
+                lock_guard<mutex> lock { _mutex };
+                auto now { steady_clock::now() };
+                return waitFor(origin, originOf(origin, now), now);
+            }
+
+            // Takes a token for a request to 'origin' and tells how long to wait before sending
+            // it; throws while the origin's circuit is open. Once it has been open long enough
+            // the request becomes the single probe deciding whether it closes again.
+            HttpReservation reserve(const string& origin) {
+                lock_guard<mutex> lock { _mutex };
+                auto now { steady_clock::now() };
+                Origin& state { originOf(origin, now) };
+                auto wait { waitFor(origin, state, now) };
+                state.tokens -= 1.0;
+                if (state.openUntil.has_value()) {
+                    state.probe = ++_probes;
+                }
+                return HttpReservation { wait, state.probe };
+            }
+
+            // For a request reserve() let through that ends without an outcome for settle(): a
+            // transport error that is not retried, a passed deadline, a failing body sink or a
+            // cancellation. None of these tells whether the server recovered, so a probe is
+            // released and the next request becomes the probe instead. 'probe' is the ticket
+            // reserve() gave the request; any other request leaves the probe in flight alone.
+            void release(const string& origin, size_t probe) {
+                lock_guard<mutex> lock { _mutex };
+                auto found { _origins.find(origin) };
+                if (found != _origins.end() && probe != 0 && found->second.probe == probe) {
+                    found->second.probe = 0;
+                }
+            }
+
+            // Records how attempt number 'attempt' to 'origin' ended: with 'response', or without
+            // one after a transport error worth retrying. Returns how long to wait before trying
+            // again, or nullopt when the outcome stands. 'probe' is the ticket reserve() gave
+            // the attempt, 'previous' the last delay returned.
+            optional<milliseconds> settle(const string& origin, size_t probe, const optional<HttpResponse>& response, size_t attempt, milliseconds previous) {
+                lock_guard<mutex> lock { _mutex };
+                auto now { steady_clock::now() };
+                Origin& state { originOf(origin, now) };
+
+                optional<milliseconds> retryAfter { nullopt };
+                if (response.has_value()) {
+                    long status { response->status() };
+                    if (status < 500 && status != 429) {
+                        // other client errors say nothing about the server's health
+                        succeeded(state, probe);
+                        return nullopt;
+                    }
+                    if (status == 429 || status == 503) {
+                        ++_stats.throttled;
+                        retryAfter = retryAfterOf(*response);
+                        if (retryAfter.has_value()) {
+                            state.pausedUntil = max(state.pausedUntil, now + *retryAfter);
+                        }
+                    }
+                    // a server error is only worth retrying when it is likely to be transient
+                    if (status != 429 && status != 502 && status != 503 && status != 504) {
+                        failed(state, probe, now);
+                        return nullopt;
+                    }
+                }
+                failed(state, probe, now);
+
+                if (attempt >= _retryPolicy.maxAttempts || state.openUntil.has_value()) {
+                    return nullopt;
+                }
+                if (retryAfter.has_value() && *retryAfter > _retryPolicy.maxRetryAfter) {
+                    return nullopt;
+                }
+                if (_budget < 1.0) {
+                    ++_stats.retriesDenied;
+                    return nullopt;
+                }
+                _budget -= 1.0;
+                ++_stats.retries;
+                return max(backoff(previous), retryAfter.value_or(milliseconds { 0 }));
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+export module spt.infrastructure:httprecording;
+
+import std;
+import :httpheaders;
+import :jsonbinder;
+import :jsondocument;
+import :jsonwriter;
+
+namespace spt::infrastructure::net {
+    using std::ifstream;
+    using std::ios;
+    using std::istreambuf_iterator;
+    using std::lock_guard;
+    using std::make_shared;
+    using std::milli;
+    using std::move;
+    using std::mutex;
+    using std::ofstream;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::streamsize;
+    using std::string;
+    using std::string_view;
+    using std::vector;
+    using std::chrono::duration;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using std::filesystem::path;
+
+    // One request and the response it got, as recorded from the network.
+    export struct HttpExchange {
+        string method;
+        string url;
+        long status;
+        HttpHeaders headers;
+        string body;            // decoded
+        microseconds elapsed;   // from sending the request to the last body byte
+    };
+
+    // The on-disk form of an exchange; headers are kept as "Name: value" lines.
+    struct HttpExchangeRecord {
+        string method;
+        string url;
+        double status;
+        double elapsedMs;
+        vector<string> headers;
+        string body;
+    };
+}
+
+namespace spt::infrastructure::text {
+    using std::tuple;
+    using spt::infrastructure::net::HttpExchangeRecord;
+
+    template <>
+    struct JsonBinding<HttpExchangeRecord> {
+        static constexpr auto fields = tuple {
+            JsonField { "method", &HttpExchangeRecord::method },
+            JsonField { "url", &HttpExchangeRecord::url },
+            JsonField { "status", &HttpExchangeRecord::status },
+            JsonField { "elapsedMs", &HttpExchangeRecord::elapsedMs },
+            JsonField { "headers", &HttpExchangeRecord::headers },
+            JsonField { "body", &HttpExchangeRecord::body }
+        };
+    };
+}
+
+namespace spt::infrastructure::net {
+    using spt::infrastructure::text::JsonBinder;
+    using spt::infrastructure::text::JsonDocument;
+    using spt::infrastructure::text::JsonWriter;
+
+    // Collects exchanges while a client with the recording attached talks to the network, and
+    // stores them as a JSON array that an HttpReplayServer can serve back. Every attempt is
+    // recorded, so throttled responses and their retries replay in the order they happened.
+    export class HttpRecording final {
+        private:
+            mutable mutex _mutex;
+            vector<HttpExchange> _exchanges;
+
+        public:
+            HttpRecording()
+                : _mutex { },
+                  _exchanges { }
+            {
+            }
+
+            HttpRecording(const HttpRecording&) = delete;
+            HttpRecording& operator=(const HttpRecording&) = delete;
+
+            static shared_ptr<HttpRecording> load(const path& file) {
+                ifstream stream { file, ios::binary };
+                if (!stream) {
+                    throw runtime_error { "Failed to open recording " + file.string() };
+                }
+                JsonDocument document { string { istreambuf_iterator<char> { stream }, istreambuf_iterator<char> { } } };
+
+                auto result { make_shared<HttpRecording>() };
+                for (auto element : document.root()) {
+                    auto record { JsonBinder::decode<HttpExchangeRecord>(element) };
+                    HttpHeaders headers { };
+                    for (const auto& line : record.headers) {
+                        headers.parse(line);
+                    }
+                    result->_exchanges.push_back(HttpExchange {
+                        move(record.method),
+                        move(record.url),
+                        static_cast<long>(record.status),
+                        move(headers),
+                        move(record.body),
+                        duration_cast<microseconds>(duration<double, milli> { record.elapsedMs })
+                    });
+                }
+                return result;
+            }
+
+            void save(const path& file) const {
+                ofstream stream { file, ios::binary };
+                if (!stream) {
+                    throw runtime_error { "Failed to create recording " + file.string() };
+                }
+                JsonWriter writer { [&stream](string_view chunk) {
+                    stream.write(chunk.data(), static_cast<streamsize>(chunk.size()));
+                } };
+
+                lock_guard<mutex> lock { _mutex };
+                writer.onStartArray();
+                string line { };
+                for (const auto& exchange : _exchanges) {
+                    writer.onStartObject();
+                    writer.onKey("method");
+                    writer.onString(exchange.method);
+                    writer.onKey("url");
+                    writer.onString(exchange.url);
+                    writer.onKey("status");
+                    writer.onNumber(static_cast<double>(exchange.status));
+                    writer.onKey("elapsedMs");
+                    writer.onNumber(duration<double, milli> { exchange.elapsed }.count());
+                    writer.onKey("headers");
+                    writer.onStartArray();
+                    for (const auto& [name, value] : exchange.headers) {
+                        line.assign(name).append(": ").append(value);
+                        writer.onString(line);
+                    }
+                    writer.onEndArray();
+                    writer.onKey("body");
+                    writer.onString(exchange.body);
+                    writer.onEndObject();
+                }
+                writer.onEndArray();
+                writer.flush();
+            }
+
+            void add(HttpExchange exchange) {
+                lock_guard<mutex> lock { _mutex };
+                _exchanges.push_back(move(exchange));
+            }
+
+            vector<HttpExchange> exchanges() const {
+                lock_guard<mutex> lock { _mutex };
+                return _exchanges;
+            }
+
+            size_t size() const {
+                lock_guard<mutex> lock { _mutex };
+                return _exchanges.size();
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,422 @@
+export module spt.infrastructure:httpreplayserver;
+
+#if defined(_WIN32)
+import <winsock2.h>;
+import <ws2tcpip.h>;
+#else
+import <arpa/inet.h>;
+import <netinet/in.h>;
+import <sys/select.h>;
+import <sys/socket.h>;
+import <unistd.h>;
+#endif
+
+import std;
+import :httpheaders;
+import :httprecording;
+import :httprequest;
+
+namespace spt::infrastructure::net {
+    using std::atomic;
+    using std::bernoulli_distribution;
+    using std::condition_variable_any;
+    using std::erase_if;
+    using std::format;
+    using std::from_chars;
+    using std::invalid_argument;
+    using std::jthread;
+    using std::lock_guard;
+    using std::make_shared;
+    using std::move;
+    using std::mt19937_64;
+    using std::mutex;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::stop_token;
+    using std::string;
+    using std::string_view;
+    using std::uint16_t;
+    using std::uint64_t;
+    using std::uniform_int_distribution;
+    using std::unique_lock;
+    using std::unordered_map;
+    using std::vector;
+    using std::chrono::milliseconds;
+    using std::chrono::steady_clock;
+
+#if defined(_WIN32)
+    using socket_t = SOCKET;
+    constexpr socket_t invalidSocket { INVALID_SOCKET };
+    constexpr int sendFlags { 0 };
+
+    void closeSocket(socket_t socket) {
+        closesocket(socket);
+    }
+#else
+    using socket_t = int;
+    constexpr socket_t invalidSocket { -1 };
+    // a client hanging up must not raise SIGPIPE
+    constexpr int sendFlags { MSG_NOSIGNAL };
+
+    void closeSocket(socket_t socket) {
+        close(socket);
+    }
+#endif
+
+    export struct HttpReplayOptions {
+        milliseconds latency;       // before every response
+        milliseconds jitter;        // up to this much more, at random
+        double errorRate;           // share of requests answered with a 503 instead
+        size_t bandwidth;           // body bytes per second on each connection, 0 for unlimited
+        bool recordedLatency;       // wait as long as the recorded exchange took instead of 'latency'
+        uint64_t seed;              // runs with the same seed inject the same errors and delays
+    };
+
+    export struct HttpReplayStats {
+        size_t requests;
+        size_t served;              // answered from the recording
+        size_t injectedErrors;
+        size_t unmatched;           // answered with a 404
+    };
+
+    // A local HTTP/1.1 server answering requests from an HttpRecording, so the whole fetch path
+    // can be run offline and repeatably; route a client's origin to origin() to use it. A
+    // request is matched on its method, path and query. Exchanges recorded more than once for
+    // the same request are served in the order they were recorded, and the last one repeats.
+    // Latency, jitter, errors and a bandwidth limit can be added to mimic a remote server.
+    export class HttpReplayServer final {
+        private:
+            struct Responses {
+                vector<HttpExchange> exchanges;
+                size_t next;
+            };
+
+            struct Connection {
+                jthread thread;
+                shared_ptr<atomic<bool>> finished;
+            };
+
+            static constexpr long pollMs { 100 };
+            // the bandwidth limit is applied in slices of this length
+            static constexpr long sliceMs { 50 };
+
+            HttpReplayOptions _options;
+            socket_t _listener;
+            uint16_t _port;
+            mutable mutex _mutex;
+            unordered_map<string, Responses> _responses;
+            mt19937_64 _random;
+            HttpReplayStats _stats;
+            vector<Connection> _connections;
+            jthread _acceptor;
+
+            static string keyOf(string_view method, string_view target) {
+                return string { method } + ' ' + string { target };
+            }
+
+            static string_view reasonOf(long status) {
+                switch (status) {
+                    case 200: return "OK";
+                    case 204: return "No Content";
+                    case 304: return "Not Modified";
+                    case 400: return "Bad Request";
+                    case 404: return "Not Found";
+                    case 429: return "Too Many Requests";
+                    case 500: return "Internal Server Error";
+                    case 502: return "Bad Gateway";
+                    case 503: return "Service Unavailable";
+                    case 504: return "Gateway Timeout";
+                    default: return "";
+                }
+            }
+
+            // The server frames the body itself, and serves it as recorded: decoded and whole.
+            static bool replayed(string_view name) {
+                for (string_view skipped : { "Content-Length", "Transfer-Encoding", "Content-Encoding", "Connection", "Keep-Alive" }) {
+                    if (HttpHeaders::equalsIgnoreCase(name, skipped)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Sleeps for 'duration' unless the server stops first; returns whether it did not.
+            static bool pause(stop_token stop, steady_clock::duration duration) {
+                if (duration <= steady_clock::duration::zero()) {
+                    return !stop.stop_requested();
+                }
+                mutex waiting { };
+                condition_variable_any wakeup { };
+                unique_lock<mutex> lock { waiting };
+                wakeup.wait_for(lock, stop, duration, [] { return false; });
+                return !stop.stop_requested();
+            }
+
+            // Waits up to pollMs for 'socket' to become readable, so stop requests are noticed.
+            static bool readable(socket_t socket) {
+                fd_set sockets { };
+                FD_ZERO(&sockets);
+                FD_SET(socket, &sockets);
+                timeval timeout { 0, pollMs * 1000 };
+                return select(static_cast<int>(socket + 1), &sockets, nullptr, nullptr, &timeout) > 0;
+            }
+
+            static bool sendAll(socket_t socket, string_view data) {
+                while (!data.empty()) {
+                    auto sent { send(socket, data.data(), static_cast<int>(data.size()), sendFlags) };
+                    if (sent <= 0) {
+                        return false;
+                    }
+                    data.remove_prefix(static_cast<size_t>(sent));
+                }
+                return true;
+            }
+
+            void accept(stop_token stop) {
+                while (!stop.stop_requested()) {
+                    if (!readable(_listener)) {
+                        continue;
+                    }
+                    socket_t socket { ::accept(_listener, nullptr, nullptr) };
+                    if (socket == invalidSocket) {
+                        continue;
+                    }
+
+                    lock_guard<mutex> lock { _mutex };
+                    // threads of closed connections are joined here rather than piling up
+                    erase_if(_connections, [](const Connection& connection) {
+                        return connection.finished->load();
+                    });
+                    auto finished { make_shared<atomic<bool>>(false) };
+                    _connections.push_back(Connection {
+                        jthread { [this, socket, finished](stop_token stop) {
+                            serve(stop, socket);
+                            closeSocket(socket);
+                            finished->store(true);
+                        } },
+                        finished
+                    });
+                }
+            }
+
+            // Answers requests on one kept-alive connection until the client closes it.
+            void serve(stop_token stop, socket_t socket) {
+                string received { };
+                char chunk[16 * 1024];
+                while (!stop.stop_requested()) {
+                    size_t end { received.find("\r\n\r\n") };
+                    if (end == string::npos) {
+                        if (!readable(socket)) {
+                            continue;
+                        }
+                        auto count { recv(socket, chunk, static_cast<int>(sizeof(chunk)), 0) };
+                        if (count <= 0) {
+                            return;
+                        }
+                        received.append(chunk, static_cast<size_t>(count));
+                        continue;
+                    }
+
+                    // "GET /v8/finance/chart/MSFT?range=1d HTTP/1.1" and its headers
+                    string_view head { string_view { received }.substr(0, end) };
+                    size_t lineEnd { head.find("\r\n") };
+                    string_view requestLine { head.substr(0, lineEnd) };
+                    size_t first { requestLine.find(' ') };
+                    size_t last { requestLine.rfind(' ') };
+                    if (first == string_view::npos || last <= first) {
+                        sendAll(socket, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+                        return;
+                    }
+                    HttpHeaders headers { };
+                    while (lineEnd != string_view::npos) {
+                        size_t start { lineEnd + 2 };
+                        lineEnd = head.find("\r\n", start);
+                        headers.parse(head.substr(start, lineEnd == string_view::npos ? string_view::npos : lineEnd - start));
+                    }
+
+                    // a request body is read past, it plays no part in matching
+                    size_t length { 0 };
+                    if (auto value { headers.get("Content-Length") }; value.has_value()) {
+                        from_chars(value->data(), value->data() + value->size(), length);
+                    }
+                    while (received.size() < end + 4 + length) {
+                        if (stop.stop_requested()) {
+                            return;
+                        }
+                        if (!readable(socket)) {
+                            continue;
+                        }
+                        auto count { recv(socket, chunk, static_cast<int>(sizeof(chunk)), 0) };
+                        if (count <= 0) {
+                            return;
+                        }
+                        received.append(chunk, static_cast<size_t>(count));
+                    }
+
+                    bool close { headers.get("Connection").transform([](string_view value) {
+                        return HttpHeaders::equalsIgnoreCase(value, "close");
+                    }).value_or(false) };
+                    string key { keyOf(requestLine.substr(0, first), requestLine.substr(first + 1, last - first - 1)) };
+                    received.erase(0, end + 4 + length);
+
+                    if (!respond(stop, socket, key, close) || close) {
+                        return;
+                    }
+                }
+            }
+
+            bool respond(stop_token stop, socket_t socket, const string& key, bool close) {
+                long status { 503 };
+                string head { };
+                string body { "Injected error" };
+                steady_clock::duration delay { _options.latency };
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    ++_stats.requests;
+                    if (_options.jitter.count() > 0) {
+                        delay += milliseconds { uniform_int_distribution<milliseconds::rep> { 0, _options.jitter.count() }(_random) };
+                    }
+
+                    auto responses { _responses.find(key) };
+                    if (_options.errorRate > 0.0 && bernoulli_distribution { _options.errorRate }(_random)) {
+                        ++_stats.injectedErrors;
+                    } else if (responses == _responses.end()) {
+                        ++_stats.unmatched;
+                        status = 404;
+                        body = format("No recorded response for {0}", key);
+                    } else {
+                        auto& [exchanges, next] = responses->second;
+                        const HttpExchange& exchange { exchanges[next < exchanges.size() ? next : exchanges.size() - 1] };
+                        ++next;
+                        ++_stats.served;
+                        status = exchange.status;
+                        body = exchange.body;
+                        for (const auto& [name, value] : exchange.headers) {
+                            if (replayed(name)) {
+                                head.append(name).append(": ").append(value).append("\r\n");
+                            }
+                        }
+                        if (_options.recordedLatency) {
+                            delay = exchange.elapsed + (delay - _options.latency);
+                        }
+                    }
+                }
+
+                if (!pause(stop, delay)) {
+                    return false;
+                }
+
+                string response { format("HTTP/1.1 {0} {1}\r\n", status, reasonOf(status)) };
+                response.append(head);
+                response.append(format("Content-Length: {0}\r\n", body.size()));
+                if (close) {
+                    response.append("Connection: close\r\n");
+                }
+                response.append("\r\n");
+                if (_options.bandwidth == 0) {
+                    return sendAll(socket, response + body);
+                }
+
+                if (!sendAll(socket, response)) {
+                    return false;
+                }
+                size_t slice { _options.bandwidth * sliceMs / 1000 };
+                slice = slice == 0 ? 1 : slice;
+                string_view rest { body };
+                while (!rest.empty()) {
+                    auto started { steady_clock::now() };
+                    string_view part { rest.substr(0, slice) };
+                    if (!sendAll(socket, part)) {
+                        return false;
+                    }
+                    rest.remove_prefix(part.size());
+                    if (!rest.empty() && !pause(stop, started + milliseconds { sliceMs } - steady_clock::now())) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        public:
+            // Starts serving 'recording' on a free port of the loopback interface.
+            explicit HttpReplayServer(const HttpRecording& recording, HttpReplayOptions options = { milliseconds { 0 }, milliseconds { 0 }, 0.0, 0, false, 42 })
+                : _options { options },
+                  _listener { invalidSocket },
+                  _port { 0 },
+                  _mutex { },
+                  _responses { },
+                  _random { options.seed },
+                  _stats { },
+                  _connections { },
+                  _acceptor { }
+            {
+                if (options.errorRate < 0.0 || options.errorRate > 1.0 || options.latency.count() < 0 || options.jitter.count() < 0) {
+                    throw invalid_argument { "Invalid replay options" };
+                }
+#if defined(_WIN32)
+                static bool init = false;
+                if (!init) {
+                    WSADATA data { };
+                    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+                        throw runtime_error { "Failed to initialize Winsock" };
+                    }
+                    init = true;
+                }
+#endif
+                for (auto& exchange : recording.exchanges()) {
+                    string target { string_view { exchange.url }.substr(HttpRequest::originOf(exchange.url).size()) };
+                    auto& responses { _responses[keyOf(exchange.method, target.empty() ? "/" : target)] };
+                    responses.exchanges.push_back(move(exchange));
+                }
+
+                _listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                if (_listener == invalidSocket) {
+                    throw runtime_error { "Failed to create the replay server socket" };
+                }
+                sockaddr_in address { };
+                address.sin_family = AF_INET;
+                address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                address.sin_port = 0;
+                socklen_t size { sizeof(address) };
+                if (bind(_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                    || listen(_listener, SOMAXCONN) != 0
+                    || getsockname(_listener, reinterpret_cast<sockaddr*>(&address), &size) != 0) {
+                    closeSocket(_listener);
+                    throw runtime_error { "Failed to start the replay server" };
+                }
+                _port = ntohs(address.sin_port);
+                _acceptor = jthread { [this](stop_token stop) { accept(stop); } };
+            }
+
+            HttpReplayServer(const HttpReplayServer&) = delete;
+            HttpReplayServer& operator=(const HttpReplayServer&) = delete;
+
+            ~HttpReplayServer() {
+                _acceptor.request_stop();
+                _acceptor.join();
+                vector<Connection> connections { };
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    connections = move(_connections);
+                }
+                // each thread notices the stop within pollMs, and is joined as it is destroyed
+                connections.clear();
+                closeSocket(_listener);
+            }
+
+            uint16_t port() const {
+                return _port;
+            }
+
+            // "http://127.0.0.1:port", to route a client's requests to.
+            string origin() const {
+                return format("http://127.0.0.1:{0}", _port);
+            }
+
+            HttpReplayStats stats() const {
+                lock_guard<mutex> lock { _mutex };
+                return _stats;
+            }
+    };
+}
\ No newline at end of file
@@ -5,8 +5,13 @@ import :httpheaders;
 
 namespace spt::infrastructure::net {
     using std::map;
+    using std::nullopt;
+    using std::optional;
+    using std::size_t;
     using std::string;
     using std::string_view;
+    using std::tolower;
+    using std::chrono::steady_clock;
 
     export enum class HttpMethod {
         GET,
@@ -21,13 +26,15 @@ namespace spt::infrastructure::net {
             HttpMethod _method;
             string _body;
             HttpHeaders _headers;
+            optional<steady_clock::time_point> _deadline;
 
         public:
             HttpRequest(string_view url, HttpMethod method) 
                 : _url { url }, 
                   _method { method },
                   _body { },
-                  _headers { }
+                  _headers { },
+                  _deadline { nullopt }
             {
             }
 
@@ -35,6 +42,26 @@ namespace spt::infrastructure::net {
                 return _url;
             }
 
+            void setUrl(string_view url) {
+                _url = url;
+            }
+
+            string origin() const {
+                return originOf(_url);
+            }
+
+            // "scheme://host:port", the unit connections are reused and requests throttled for.
+            static string originOf(string_view url) {
+                size_t start { url.find("://") };
+                start = start == string_view::npos ? 0 : start + 3;
+                size_t end { url.find_first_of("/?#", start) };
+                string origin { url.substr(0, end) };
+                for (auto& ch : origin) {
+                    ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+                }
+                return origin;
+            }
+
             HttpMethod method() const {
                 return _method;
             }
@@ -47,13 +74,26 @@ namespace spt::infrastructure::net {
                 return _headers;
             }
 
-            void setHeader(const string& key, const string& value) {
-                _headers.set(key, value);
+            void setHeader(string_view name, string_view value) {
+                _headers.set(name, value);
+            }
+
+            bool removeHeader(string_view name) {
+                return _headers.remove(name);
             }
 
             void setBody(const string& body) {
                 _body = body;
             }
 
+            // Point in time after which the request fails, however long it has been queued or
+            // in flight. Without one only the client timeout applies.
+            optional<steady_clock::time_point> deadline() const {
+                return _deadline;
+            }
+
+            void setDeadline(steady_clock::time_point deadline) {
+                _deadline = deadline;
+            }
     };
 }
\ No newline at end of file
@@ -1,24 +1,61 @@
 export module spt.infrastructure:httpresponse;
 
 import std;
+import :httpbuffer;
 import :httpheaders;
 
 namespace spt::infrastructure::net {
+    using std::move;
+    using std::size_t;
     using std::string;
     using std::string_view;
+    using std::chrono::microseconds;
     using spt::infrastructure::net::HttpHeaders;
 
+    // Body bytes as they crossed the network and after content decoding; the two only differ
+    // when the server compressed the response.
+    export struct HttpBodySize {
+        size_t wire;
+        size_t decoded;
+    };
+
+    // Where the time of a request went, phase by phase; phases a reused connection skips are 0.
+    export struct HttpTimings {
+        microseconds nameLookup;    // resolving the host name
+        microseconds connect;       // the TCP handshake
+        microseconds tls;           // the TLS handshake
+        microseconds preTransfer;   // protocol setup once connected, e.g. HTTP/2 negotiation
+        microseconds server;        // sending the request and waiting for the first byte back
+        microseconds transfer;      // receiving the rest of the response
+        microseconds total;
+    };
+
     export class HttpResponse final {
         private:
             long _status;
-            string _body;
+            HttpBuffer _body;
             HttpHeaders _headers;
+            HttpBodySize _bodySize;
+            HttpTimings _timings;
 
         public:
-            HttpResponse(long status, string_view body, const HttpHeaders& headers) 
+            HttpResponse(long status, string_view body, HttpHeaders headers, HttpBodySize bodySize = { }) 
+                : _status { status },
+                  _body { string { body } },
+                  _headers { move(headers) },
+                  _bodySize { bodySize },
+                  _timings { }
+            {
+            }
+
+            // Takes over a downloaded body without copying it; a pooled buffer goes back to
+            // its pool once the last response moved from this one is gone.
+            HttpResponse(long status, HttpBuffer body, HttpHeaders headers, HttpBodySize bodySize, HttpTimings timings = { })
                 : _status { status },
-                  _body { body },
-                  _headers { headers } 
+                  _body { move(body) },
+                  _headers { move(headers) },
+                  _bodySize { bodySize },
+                  _timings { timings }
             {
             }
 
@@ -31,11 +68,20 @@ namespace spt::infrastructure::net {
             }
 
             string_view body() const {
-                return _body;
+                return _body.view();
             }
 
             const HttpHeaders& headers() const {
                 return _headers;
             }
+
+            HttpBodySize bodySize() const {
+                return _bodySize;
+            }
+
+            // All zero for responses that did not come from the network, e.g. cache hits.
+            HttpTimings timings() const {
+                return _timings;
+            }
     };
 }
\ No newline at end of file
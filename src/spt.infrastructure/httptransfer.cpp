@@ -0,0 +1,381 @@
+export module spt.infrastructure:httptransfer;
+
+import <curl/curl.h>;
+
+import std;
+import :httpbuffer;
+import :httpconnectionpool;
+import :httpheaders;
+import :httpmetrics;
+import :httprecording;
+import :httprequest;
+import :httpresponse;
+
+namespace spt::infrastructure::net {
+    using std::current_exception;
+    using std::exception_ptr;
+    using std::format;
+    using std::function;
+    using std::max;
+    using std::min;
+    using std::move;
+    using std::optional;
+    using std::rethrow_exception;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::unique_ptr;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using std::chrono::milliseconds;
+    using std::chrono::steady_clock;
+
+    export enum class HttpVersion {
+        Http1,      // HTTP/1.1, one request per connection at a time
+        Http2,      // HTTP/2 negotiated through TLS ALPN, falling back to HTTP/1.1
+        Http2Only   // HTTP/2 without negotiation, also over cleartext (h2c prior knowledge)
+    };
+
+    // Client settings a transfer is configured with.
+    export struct HttpTransferOptions {
+        long timeout;           // seconds, 0 for none
+        HttpVersion version;
+        bool compressed;        // offer every content encoding libcurl can decode
+        shared_ptr<HttpRecording> recording;    // every response is added when set
+        shared_ptr<HttpMetrics> metrics;        // every response's timings are added when set
+    };
+
+    // One request on a leased easy handle: configures the handle, owns everything libcurl
+    // points into while the transfer runs, and turns the outcome into an HttpResponse. The
+    // same transfer runs blocking through curl_easy_perform or on the event loop's multi
+    // handle, so both paths behave identically.
+    export class HttpTransfer final {
+        public:
+            using body_sink_t = function<void(string_view)>;
+
+        private:
+            using curl_list_t = unique_ptr<curl_slist, decltype(&curl_slist_free_all)>;
+
+            HttpConnectionPool::Lease _lease;
+            curl_list_t _headers;
+            string _requestBody;
+            optional<steady_clock::time_point> _deadline;
+            bool _deadlineBound;
+            body_sink_t _sink;
+            HttpBuffer _body;
+            bool _buffered;
+            HttpHeaders _responseHeaders;
+            exception_ptr _error;
+            size_t _decoded;
+            bool _streamed;
+            shared_ptr<HttpRecording> _recording;
+            shared_ptr<HttpMetrics> _metrics;
+            HttpMethod _method;
+            string _url;
+            string _recorded;       // a streamed body, kept for the recording
+
+            static curl_list_t makeHeaders(const HttpHeaders& headers) {
+                struct curl_slist* list { nullptr };
+                string line { };
+                for (const auto& [name, value] : headers) {
+                    line.assign(name).append(": ").append(value);
+                    list = curl_slist_append(list, line.c_str());
+                }
+                return { list, &curl_slist_free_all };
+            }
+
+            static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+                auto* transfer = static_cast<HttpTransfer*>(userp);
+                string_view chunk { static_cast<char*>(contents), size * nmemb };
+                transfer->_decoded += chunk.size();
+
+                if (transfer->_sink) {
+                    long code { 0L };
+                    curl_easy_getinfo(transfer->handle(), CURLINFO_RESPONSE_CODE, &code);
+                    if (code >= 200 && code < 300) {
+                        transfer->_streamed = true;
+                        if (transfer->_recording != nullptr) {
+                            transfer->_recorded.append(chunk);
+                        }
+                        try {
+                            transfer->_sink(chunk);
+                        } catch (...) {
+                            // exceptions must not cross libcurl, returning 0 aborts the transfer
+                            transfer->_error = current_exception();
+                            return 0;
+                        }
+                        return chunk.size();
+                    }
+                }
+
+                transfer->buffer(chunk);
+                return chunk.size();
+            }
+
+            // The body goes into a pooled buffer taken with the first chunk, sized for the whole
+            // body when the server announced its length. With compression that is the encoded
+            // length, so a buffer may still grow; it keeps the capacity for the next response.
+            void buffer(string_view chunk) {
+                if (!_buffered) {
+                    curl_off_t length { -1 };
+                    curl_easy_getinfo(handle(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+                    size_t expected { length > 0 ? static_cast<size_t>(length) : 0 };
+                    _body = HttpBuffer { HttpBufferPool::shared(), max(expected, chunk.size()) };
+                    _buffered = true;
+                }
+                _body.append(chunk);
+            }
+
+            // Called with one complete header line at a time, parsed into the response headers
+            // as it comes. A status line starts over, so after redirects and interim (1xx)
+            // responses only the final response's headers are left.
+            static size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+                auto* headers = static_cast<HttpHeaders*>(userp);
+                string_view line { buffer, size * nitems };
+                if (line.starts_with("HTTP/")) {
+                    headers->clear();
+                } else {
+                    headers->parse(line);
+                }
+                return line.size();
+            }
+
+            void record(long code, microseconds elapsed) {
+                static constexpr string_view methods[] { "GET", "POST", "PUT", "DELETE" };
+                _recording->add(HttpExchange {
+                    string { methods[static_cast<size_t>(_method)] },
+                    _url,
+                    code,
+                    _responseHeaders,
+                    _streamed ? move(_recorded) : string { _body.view() },
+                    elapsed
+                });
+            }
+
+            // libcurl reports when each phase ended, counted from the start of the transfer.
+            HttpTimings timings() const {
+                curl_off_t lookup { 0 };
+                curl_off_t connect { 0 };
+                curl_off_t appConnect { 0 };
+                curl_off_t preTransfer { 0 };
+                curl_off_t startTransfer { 0 };
+                curl_off_t total { 0 };
+                curl_easy_getinfo(handle(), CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+                curl_easy_getinfo(handle(), CURLINFO_CONNECT_TIME_T, &connect);
+                curl_easy_getinfo(handle(), CURLINFO_APPCONNECT_TIME_T, &appConnect);
+                curl_easy_getinfo(handle(), CURLINFO_PRETRANSFER_TIME_T, &preTransfer);
+                curl_easy_getinfo(handle(), CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+                curl_easy_getinfo(handle(), CURLINFO_TOTAL_TIME_T, &total);
+
+                auto between = [](curl_off_t from, curl_off_t to) {
+                    return microseconds { to > from ? to - from : 0 };
+                };
+                // 0 when there was no TLS handshake, and for reused connections
+                curl_off_t connected { appConnect > 0 ? appConnect : connect };
+                return HttpTimings {
+                    microseconds { lookup },
+                    between(lookup, connect),
+                    appConnect > 0 ? between(connect, appConnect) : microseconds { 0 },
+                    between(connected, preTransfer),
+                    between(preTransfer, startTransfer),
+                    between(startTransfer, total),
+                    microseconds { total }
+                };
+            }
+
+            // The client timeout (in seconds, 0 meaning none) cut short by the request deadline.
+            void applyTimeout(CURL* curl, long timeout) {
+                long limit { timeout * 1000L };
+                if (_deadline.has_value()) {
+                    auto left { duration_cast<milliseconds>(*_deadline - steady_clock::now()).count() };
+                    auto bounded { static_cast<long>(max<decltype(left)>(left, 1)) };
+                    if (limit == 0L || bounded < limit) {
+                        limit = bounded;
+                        _deadlineBound = true;
+                    }
+                }
+                curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, limit);
+            }
+
+            // With HTTP/2 a new request waits for a connection that is still being set up
+            // instead of opening another one, so requests to one origin share it as streams.
+            static void applyVersion(CURL* curl, HttpVersion version) {
+                switch (version) {
+                    case HttpVersion::Http2:
+                        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+                        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+                        break;
+                    case HttpVersion::Http2Only:
+                        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+                        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+                        break;
+                    case HttpVersion::Http1:
+                    default:
+                        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+                        break;
+                }
+            }
+
+        public:
+            HttpTransfer(HttpConnectionPool::Lease lease, const HttpRequest& request, const HttpTransferOptions& options, body_sink_t sink)
+                : _lease { move(lease) },
+                  _headers { makeHeaders(request.headers()) },
+                  _requestBody { request.body() },
+                  _deadline { request.deadline() },
+                  _deadlineBound { false },
+                  _sink { move(sink) },
+                  _body { },
+                  _buffered { false },
+                  _responseHeaders { },
+                  _error { nullptr },
+                  _decoded { 0 },
+                  _streamed { false },
+                  _recording { options.recording },
+                  _metrics { options.metrics },
+                  _method { request.method() },
+                  _url { _recording != nullptr || _metrics != nullptr ? string { request.url() } : string { } },
+                  _recorded { }
+            {
+                if (expired(request)) {
+                    throw deadlineExceeded();
+                }
+
+                CURL* curl { handle() };
+                curl_easy_setopt(curl, CURLOPT_URL, string { request.url() }.c_str());
+                curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+                applyTimeout(curl, options.timeout);
+                applyVersion(curl, options.version);
+                if (options.compressed) {
+                    // an empty list makes libcurl offer what it was built with (gzip and deflate,
+                    // plus br and zstd when available) and decode the body as it arrives, so the
+                    // write callback only ever sees decoded chunks
+                    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+                }
+                curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+                curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+                curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
+                curl_easy_setopt(curl, CURLOPT_HEADERDATA, &_responseHeaders);
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, _headers.get());
+                curl_easy_setopt(curl, CURLOPT_USERAGENT, "HttpClient/2.0");
+                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+                curl_easy_setopt(curl, CURLOPT_PRIVATE, this);
+
+                switch (request.method()) {
+                    case HttpMethod::POST:
+                        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+                        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, _requestBody.c_str());
+                        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, _requestBody.size());
+                        break;
+                    case HttpMethod::PUT:
+                        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+                        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, _requestBody.c_str());
+                        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, _requestBody.size());
+                        break;
+                    case HttpMethod::DEL:
+                        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+                        break;
+                    case HttpMethod::GET:
+                    default:
+                        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+                        break;
+                }
+            }
+
+            // libcurl keeps pointers to this object while the transfer runs.
+            HttpTransfer(const HttpTransfer&) = delete;
+            HttpTransfer& operator=(const HttpTransfer&) = delete;
+
+            // Whether the request deadline passes now or, with 'within', before that much time.
+            static bool expired(const HttpRequest& request, steady_clock::duration within = steady_clock::duration::zero()) {
+                return request.deadline().has_value() && steady_clock::now() + within >= *request.deadline();
+            }
+
+            static runtime_error deadlineExceeded() {
+                return runtime_error { "Request deadline exceeded" };
+            }
+
+            static runtime_error cancelled() {
+                return runtime_error { "Request was cancelled" };
+            }
+
+            CURL* handle() const {
+                return _lease.handle();
+            }
+
+            // The transfer was abandoned half way; its connection cannot be reused.
+            void abandon() {
+                _lease.discard();
+            }
+
+            // Whether a failed transfer is worth another attempt: the connection could not be
+            // made or broke off before any of the body reached the sink, and neither the deadline
+            // nor the sink ended it.
+            bool retryable(CURLcode result) const {
+                if (_error != nullptr || _streamed || (result == CURLE_OPERATION_TIMEDOUT && _deadlineBound)) {
+                    return false;
+                }
+                switch (result) {
+                    case CURLE_COULDNT_RESOLVE_HOST:
+                    case CURLE_COULDNT_CONNECT:
+                    case CURLE_OPERATION_TIMEDOUT:
+                    case CURLE_SSL_CONNECT_ERROR:
+                    case CURLE_SEND_ERROR:
+                    case CURLE_RECV_ERROR:
+                    case CURLE_GOT_NOTHING:
+                    case CURLE_PARTIAL_FILE:
+                    case CURLE_HTTP2:
+                    case CURLE_HTTP2_STREAM:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            // Builds the response once libcurl has finished with 'result', throwing for
+            // transport errors, a passed deadline or an exception raised by the body sink.
+            HttpResponse complete(CURLcode result) {
+                if (result != CURLE_OK) {
+                    _lease.discard();
+                }
+                if (_error != nullptr) {
+                    rethrow_exception(_error);
+                }
+                if (result == CURLE_OPERATION_TIMEDOUT && _deadlineBound) {
+                    throw deadlineExceeded();
+                }
+                if (result != CURLE_OK) {
+                    throw runtime_error {
+                        format("Error performing the request: {0}", curl_easy_strerror(result))
+                    };
+                }
+
+                // libcurl counts body bytes before they are decoded
+                curl_off_t wire { 0 };
+                curl_easy_getinfo(handle(), CURLINFO_SIZE_DOWNLOAD_T, &wire);
+                HttpBodySize bodySize { static_cast<size_t>(wire), _decoded };
+                _lease.record(bodySize);
+
+                long code { 0L };
+                curl_easy_getinfo(handle(), CURLINFO_RESPONSE_CODE, &code);
+
+                auto timings { this->timings() };
+                if (_metrics != nullptr) {
+                    _metrics->record(_url, timings, bodySize.wire);
+                }
+                if (_recording != nullptr) {
+                    record(code, timings.total);
+                }
+
+                return HttpResponse {
+                    code,
+                    move(_body),
+                    move(_responseHeaders),
+                    bodySize,
+                    timings
+                };
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+export module spt.infrastructure:jsonbinder;
+
+import std;
+import :jsondocument;
+import :jsonnumberarray;
+
+namespace spt::infrastructure::text {
+    using std::apply;
+    using std::numeric_limits;
+    using std::optional;
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    // Maps one JSON member name to a data member of 'Owner'.
+    export template <typename Owner, typename Member>
+    struct JsonField {
+        string_view name;
+        Member Owner::* member;
+    };
+
+    export template <typename Owner, typename Member>
+    JsonField(string_view, Member Owner::*) -> JsonField<Owner, Member>;
+
+    // Specialize for every struct that JsonBinder should fill, declaring its members as
+    //     static constexpr auto fields = tuple { JsonField { "name", &T::member }, ... };
+    // Members may be double, bool, string, JsonNumberArray, another bound struct, or a vector or
+    // optional of those.
+    export template <typename T>
+    struct JsonBinding;
+
+    export template <typename T>
+    concept JsonBound = requires {
+        JsonBinding<T>::fields;
+    };
+
+    // Decodes a document straight into bound structs. The field tables are known at compile
+    // time, so every object is read in a single pass over its members; members without a field
+    // are skipped over the structural index and no JsonValue is ever built.
+    export class JsonBinder final {
+        private:
+            static void read(const JsonElement& element, double& value) {
+                value = element.isNull() ? numeric_limits<double>::quiet_NaN() : element.getNumber();
+            }
+
+            static void read(const JsonElement& element, bool& value) {
+                value = element.isNull() ? false : element.getBoolean();
+            }
+
+            static void read(const JsonElement& element, string& value) {
+                if (element.isNull()) {
+                    value.clear();
+                } else {
+                    value = element.getString();
+                }
+            }
+
+            static void read(const JsonElement& element, JsonNumberArray& value) {
+                if (!element.isNull()) {
+                    value = element.getNumberArray();
+                }
+            }
+
+            template <typename T>
+            static void read(const JsonElement& element, optional<T>& value) {
+                if (!element.isNull()) {
+                    read(element, value.emplace());
+                }
+            }
+
+            template <typename T>
+            static void read(const JsonElement& element, vector<T>& value) {
+                if (element.isNull()) {
+                    return;
+                }
+                for (auto item : element) {
+                    read(item, value.emplace_back());
+                }
+            }
+
+            template <JsonBound T>
+            static void read(const JsonElement& element, T& value) {
+                if (element.isNull()) {
+                    return;
+                }
+                element.forEachMember([&value](string_view key, const JsonElement& member) {
+                    apply([&](const auto&... fields) {
+                        (bind(fields, key, member, value) || ...);
+                    }, JsonBinding<T>::fields);
+                });
+            }
+
+            template <typename Owner, typename Member>
+            static bool bind(const JsonField<Owner, Member>& field, string_view key, const JsonElement& member, Owner& target) {
+                if (field.name != key) {
+                    return false;
+                }
+                read(member, target.*(field.member));
+                return true;
+            }
+
+        public:
+            JsonBinder() = delete;
+
+            template <JsonBound T>
+            static T decode(const JsonElement& element) {
+                T result { };
+                read(element, result);
+                return result;
+            }
+
+            template <JsonBound T>
+            static T decode(const JsonDocument& document) {
+                return decode<T>(document.root());
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,389 @@
+export module spt.infrastructure:jsondocument;
+
+import std;
+import :jsonvalue;
+import :jsonnumberarray;
+import :jsonscalars;
+import :jsonstructuralindex;
+import :jsonstructuralparser;
+
+namespace spt::infrastructure::text {
+    using std::forward_iterator_tag;
+    using std::make_shared;
+    using std::move;
+    using std::out_of_range;
+    using std::ptrdiff_t;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::span;
+    using std::string;
+    using std::string_view;
+    using std::uint32_t;
+
+    // A value inside a JsonDocument, addressed by its slot in the structural index. Nothing is
+    // decoded until a getter is called, and navigating past a sibling only walks its structural
+    // characters instead of building it.
+    export class JsonElement final {
+        private:
+            string_view _json;
+            span<const uint32_t> _positions;
+            size_t _slot;
+
+            char at(size_t slot) const {
+                return slot < _positions.size() ? _json[_positions[slot]] : '\0';
+            }
+
+            size_t position(size_t slot) const {
+                return slot < _positions.size() ? _positions[slot] : _json.size();
+            }
+
+            runtime_error error(string_view message, size_t slot) const {
+                return JsonScalars::error(_json, message, position(slot));
+            }
+
+            // Returns the slot right after the value that starts at 'slot'.
+            size_t skip(size_t slot) const {
+                auto ch { at(slot) };
+                if (ch != '{' && ch != '[') {
+                    return slot + 1;
+                }
+
+                size_t depth { 0 };
+                for (; slot < _positions.size(); ++slot) {
+                    ch = at(slot);
+                    if (ch == '{' || ch == '[') {
+                        ++depth;
+                    } else if ((ch == '}' || ch == ']') && --depth == 0) {
+                        return slot + 1;
+                    }
+                }
+                throw error("Unexpected end of input", slot);
+            }
+
+            // Returns the slot following a member or element separator, or 0 once 'close' is hit.
+            size_t next(size_t slot, char close) const {
+                auto ch { at(slot) };
+                if (ch == ',') {
+                    return slot + 1;
+                }
+                if (ch != close) {
+                    throw error(close == '}' ? "Expected ',' or '}' in object" : "Expected ',' or ']' in array", slot);
+                }
+                return 0;
+            }
+
+            bool keyEquals(size_t slot, string_view key) const {
+                string scratch { };
+                return JsonScalars::readString(_json, _positions[slot], scratch) == key;
+            }
+
+            JsonElement(string_view json, span<const uint32_t> positions, size_t slot)
+                : _json { json },
+                  _positions { positions },
+                  _slot { slot }
+            {
+            }
+
+            friend class JsonDocument;
+
+        public:
+            class iterator {
+                private:
+                    string_view _json;
+                    span<const uint32_t> _positions;
+                    size_t _slot;   // 0 marks the end, slot 0 is always the document root
+
+                public:
+                    using iterator_concept = forward_iterator_tag;
+                    using value_type = JsonElement;
+                    using difference_type = ptrdiff_t;
+
+                    iterator()
+                        : _json { },
+                          _positions { },
+                          _slot { 0 }
+                    {
+                    }
+
+                    iterator(string_view json, span<const uint32_t> positions, size_t slot)
+                        : _json { json },
+                          _positions { positions },
+                          _slot { slot }
+                    {
+                    }
+
+                    JsonElement operator*() const {
+                        return JsonElement { _json, _positions, _slot };
+                    }
+
+                    iterator& operator++() {
+                        JsonElement array { _json, _positions, _slot };
+                        _slot = array.next(array.skip(_slot), ']');
+                        return *this;
+                    }
+
+                    iterator operator++(int) {
+                        iterator copy { *this };
+                        ++*this;
+                        return copy;
+                    }
+
+                    bool operator==(const iterator& other) const {
+                        return _slot == other._slot;
+                    }
+            };
+
+            bool isNull() const {
+                return at(_slot) == 'n';
+            }
+
+            bool isBoolean() const {
+                auto ch { at(_slot) };
+                return ch == 't' || ch == 'f';
+            }
+
+            bool isNumber() const {
+                auto ch { at(_slot) };
+                return ch == '-' || (ch >= '0' && ch <= '9');
+            }
+
+            bool isString() const {
+                return at(_slot) == '"';
+            }
+
+            bool isArray() const {
+                return at(_slot) == '[';
+            }
+
+            bool isObject() const {
+                return at(_slot) == '{';
+            }
+
+            bool getBoolean() const {
+                if (at(_slot) == 't') {
+                    JsonScalars::readLiteral(_json, position(_slot), "true");
+                    return true;
+                }
+                JsonScalars::readLiteral(_json, position(_slot), "false");
+                return false;
+            }
+
+            double getNumber() const {
+                if (!isNumber()) {
+                    throw error("Expected a number", _slot);
+                }
+                return JsonScalars::readNumber(_json, position(_slot));
+            }
+
+            string getString() const {
+                if (!isString()) {
+                    throw error("Expected a string", _slot);
+                }
+                string scratch { };
+                return string { JsonScalars::readString(_json, position(_slot), scratch) };
+            }
+
+            // Decodes an array of numbers and nulls straight into contiguous storage, without
+            // creating an element per entry.
+            JsonNumberArray getNumberArray() const {
+                if (!isArray()) {
+                    throw out_of_range { "Number array requested on non-array JsonElement" };
+                }
+
+                JsonNumberArray result { };
+                size_t slot { _slot + 1 };
+                if (at(slot) == ']') {
+                    return result;
+                }
+
+                // scalar entries take two slots each (value and separator)
+                size_t count { 1 };
+                for (size_t separator = slot + 1; at(separator) == ','; separator += 2) {
+                    ++count;
+                }
+                result.reserve(count);
+
+                while (slot != 0) {
+                    auto ch { at(slot) };
+                    if (ch == 'n') {
+                        JsonScalars::readLiteral(_json, position(slot), "null");
+                        result.pushNull();
+                    } else if (ch == '-' || (ch >= '0' && ch <= '9')) {
+                        result.push(JsonScalars::readNumber(_json, position(slot)));
+                    } else {
+                        throw error("Expected a number or null in numeric array", slot);
+                    }
+                    slot = next(slot + 1, ']');
+                }
+
+                return result;
+            }
+
+            // Materializes this element and everything below it.
+            JsonValue toValue() const {
+                return JsonStructuralParser::parse(_json, _positions.subspan(_slot, skip(_slot) - _slot));
+            }
+
+            size_t count() const {
+                size_t result { 0 };
+                if (isArray()) {
+                    for (auto it = begin(); it != end(); ++it) {
+                        ++result;
+                    }
+                } else if (isObject() && at(_slot + 1) != '}') {
+                    for (size_t slot = _slot + 1; slot != 0; slot = next(skip(slot + 2), '}')) {
+                        ++result;
+                    }
+                }
+                return result;
+            }
+
+            bool contains(string_view key) const {
+                if (!isObject() || at(_slot + 1) == '}') {
+                    return false;
+                }
+                for (size_t slot = _slot + 1; slot != 0; slot = next(skip(slot + 2), '}')) {
+                    if (at(slot) != '"') {
+                        throw error("Expected string key in object", slot);
+                    }
+                    if (keyEquals(slot, key)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Calls 'callback(key, value)' for every member in document order. Values are only
+            // decoded if the callback asks for them; the rest are skipped structurally.
+            template <typename Callback>
+            void forEachMember(Callback&& callback) const {
+                if (!isObject()) {
+                    throw out_of_range { "Member iteration requested on non-object JsonElement" };
+                }
+                if (at(_slot + 1) == '}') {
+                    return;
+                }
+
+                string scratch { };
+                for (size_t slot = _slot + 1; slot != 0; slot = next(skip(slot + 2), '}')) {
+                    if (at(slot) != '"') {
+                        throw error("Expected string key in object", slot);
+                    }
+                    if (at(slot + 1) != ':') {
+                        throw error("Expected ':' after object key", slot + 1);
+                    }
+                    callback(JsonScalars::readString(_json, _positions[slot], scratch), JsonElement { _json, _positions, slot + 2 });
+                }
+            }
+
+            iterator begin() const {
+                if (!isArray()) {
+                    throw out_of_range { "Iteration requested on non-array JsonElement" };
+                }
+                return iterator { _json, _positions, at(_slot + 1) == ']' ? 0 : _slot + 1 };
+            }
+
+            iterator end() const {
+                return iterator { _json, _positions, 0 };
+            }
+
+            JsonElement operator[](size_t index) const {
+                if (!isArray()) {
+                    throw out_of_range { "Indexing operator[] called on non-array JsonElement" };
+                }
+                for (auto it = begin(); it != end(); ++it, --index) {
+                    if (index == 0) {
+                        return *it;
+                    }
+                }
+                throw out_of_range { "JsonElement array index out of range" };
+            }
+
+            JsonElement operator[](string_view key) const {
+                if (!isObject()) {
+                    throw out_of_range { "Indexing operator[] called on non-object JsonElement" };
+                }
+                if (at(_slot + 1) != '}') {
+                    for (size_t slot = _slot + 1; slot != 0; slot = next(skip(slot + 2), '}')) {
+                        if (at(slot) != '"') {
+                            throw error("Expected string key in object", slot);
+                        }
+                        if (at(slot + 1) != ':') {
+                            throw error("Expected ':' after object key", slot + 1);
+                        }
+                        if (keyEquals(slot, key)) {
+                            return JsonElement { _json, _positions, slot + 2 };
+                        }
+                    }
+                }
+                throw out_of_range { "JsonElement object key not found" };
+            }
+    };
+
+    // Keeps the raw JSON text and its structural index; values are decoded on demand through
+    // JsonElement, so subtrees that are never navigated cost a skip instead of allocations.
+    // Both are immutable, so copies share them and one parsed response can be handed to many.
+    export class JsonDocument final {
+        private:
+            struct Storage {
+                string text;                    // the JSON, when the document owns it
+                shared_ptr<const void> owner;   // otherwise whatever keeps it alive
+                string_view json;
+                JsonStructuralIndex index;
+            };
+
+            shared_ptr<const Storage> _storage;
+
+            explicit JsonDocument(shared_ptr<const Storage> storage)
+                : _storage { move(storage) }
+            {
+                JsonElement root { this->root() };
+                if (_storage->index.size() == 0) {
+                    throw root.error("Unexpected end of input", 0);
+                }
+                size_t end { root.skip(0) };
+                if (end != _storage->index.size()) {
+                    throw root.error("Unexpected JSON content: end of file was expected", end);
+                }
+            }
+
+            // The index holds offsets, so it stays valid as the text moves into place.
+            static shared_ptr<const Storage> own(string json) {
+                auto index { JsonStructuralIndex::build(json) };
+                auto storage { make_shared<Storage>(move(json), nullptr, string_view { }, move(index)) };
+                storage->json = storage->text;
+                return storage;
+            }
+
+            static shared_ptr<const Storage> borrow(string_view json, shared_ptr<const void> owner) {
+                auto index { JsonStructuralIndex::build(json) };
+                return make_shared<Storage>(string { }, move(owner), json, move(index));
+            }
+
+        public:
+            explicit JsonDocument(string json)
+                : JsonDocument { own(move(json)) }
+            {
+            }
+
+            // Parses 'json' where it lies instead of copying it; 'owner' is held for as long as
+            // the document or any copy of it, and must keep 'json' alive and unchanged.
+            JsonDocument(string_view json, shared_ptr<const void> owner)
+                : JsonDocument { borrow(json, move(owner)) }
+            {
+            }
+
+            JsonElement root() const {
+                return JsonElement { _storage->json, _storage->index.positions(), 0 };
+            }
+
+            string_view json() const {
+                return _storage->json;
+            }
+
+            JsonElement operator[](string_view key) const {
+                return root()[key];
+            }
+    };
+}
\ No newline at end of file
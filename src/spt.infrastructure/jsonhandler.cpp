@@ -0,0 +1,24 @@
+export module spt.infrastructure:jsonhandler;
+
+import std;
+
+namespace spt::infrastructure::text {
+    using std::string_view;
+
+    // Receives parse events in document order. String views are only valid for the duration of
+    // the call.
+    export class JsonHandler {
+        public:
+            virtual ~JsonHandler() = default;
+
+            virtual void onNull() = 0;
+            virtual void onBoolean(bool value) = 0;
+            virtual void onNumber(double value) = 0;
+            virtual void onString(string_view value) = 0;
+            virtual void onKey(string_view key) = 0;
+            virtual void onStartObject() = 0;
+            virtual void onEndObject() = 0;
+            virtual void onStartArray() = 0;
+            virtual void onEndArray() = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+export module spt.infrastructure:jsonnumberarray;
+
+import std;
+
+namespace spt::infrastructure::text {
+    using std::numeric_limits;
+    using std::size_t;
+    using std::span;
+    using std::uint64_t;
+    using std::vector;
+
+    // A JSON array of numbers and nulls decoded into contiguous storage. Null entries hold NaN
+    // and are cleared in the validity bitmap.
+    export class JsonNumberArray final {
+        private:
+            vector<double> _values;
+            vector<uint64_t> _validity;
+
+        public:
+            JsonNumberArray()
+                : _values { },
+                  _validity { }
+            {
+            }
+
+            void reserve(size_t count) {
+                _values.reserve(count);
+                _validity.reserve((count + 63) / 64);
+            }
+
+            void push(double value) {
+                if (_values.size() % 64 == 0) {
+                    _validity.push_back(0);
+                }
+                _validity.back() |= uint64_t { 1 } << (_values.size() % 64);
+                _values.push_back(value);
+            }
+
+            void pushNull() {
+                if (_values.size() % 64 == 0) {
+                    _validity.push_back(0);
+                }
+                _values.push_back(numeric_limits<double>::quiet_NaN());
+            }
+
+            size_t size() const {
+                return _values.size();
+            }
+
+            bool empty() const {
+                return _values.empty();
+            }
+
+            bool isValid(size_t index) const {
+                return ((_validity[index / 64] >> (index % 64)) & 1) != 0;
+            }
+
+            double operator[](size_t index) const {
+                return _values[index];
+            }
+
+            span<const double> values() const {
+                return _values;
+            }
+
+            span<const uint64_t> validity() const {
+                return _validity;
+            }
+    };
+}
\ No newline at end of file
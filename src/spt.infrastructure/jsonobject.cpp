@@ -0,0 +1,294 @@
+export module spt.infrastructure:jsonobject;
+
+import std;
+
+namespace spt::infrastructure::text {
+    using std::adjacent_find;
+    using std::forward_iterator_tag;
+    using std::hash;
+    using std::iota;
+    using std::lock_guard;
+    using std::make_shared;
+    using std::move;
+    using std::mutex;
+    using std::out_of_range;
+    using std::pair;
+    using std::ptrdiff_t;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::span;
+    using std::stable_sort;
+    using std::swap;
+    using std::string_view;
+    using std::unordered_set;
+    using std::vector;
+    using std::pmr::monotonic_buffer_resource;
+
+    // Stores each distinct object key of a document once. Objects built by the same parse share
+    // a table, so a key repeated across thousands of array elements costs a single copy. Every
+    // parse makes its own table and fills it without locking; only keys added to an object after
+    // the parse, when copies may live on other threads, take the mutex.
+    export class JsonKeyTable final {
+        private:
+            mutex _mutex;
+            monotonic_buffer_resource _arena;
+            unordered_set<string_view, hash<string_view>> _keys;
+
+            string_view store(string_view key) {
+                auto found { _keys.find(key) };
+                if (found != _keys.end()) {
+                    return *found;
+                }
+
+                auto storage { static_cast<char*>(_arena.allocate(key.size() + 1, 1)) };
+                key.copy(storage, key.size());
+                storage[key.size()] = '\0';
+                return *_keys.emplace(storage, key.size()).first;
+            }
+
+        public:
+            JsonKeyTable()
+                : _mutex { },
+                  _arena { },
+                  _keys { }
+            {
+            }
+
+            JsonKeyTable(const JsonKeyTable&) = delete;
+            JsonKeyTable& operator=(const JsonKeyTable&) = delete;
+
+            // Returns a view of the stored copy of 'key', valid for the lifetime of the table.
+            // Only the parse that owns the table calls this, before any object built on it is
+            // shared, so it does not lock.
+            string_view intern(string_view key) {
+                return store(key);
+            }
+
+            // Same as intern, for a table whose objects may already be shared between threads.
+            string_view internShared(string_view key) {
+                lock_guard<mutex> lock { _mutex };
+                return store(key);
+            }
+
+            size_t size() {
+                lock_guard<mutex> lock { _mutex };
+                return _keys.size();
+            }
+    };
+
+    // Object members kept sorted by key in two parallel vectors, so a lookup is a binary search
+    // over contiguous keys and an object costs two allocations however many members it has.
+    // Keys are views into a JsonKeyTable that every copy of the object keeps alive.
+    export template <typename Value>
+    class JsonObject final {
+        private:
+            shared_ptr<JsonKeyTable> _table;
+            vector<string_view> _keys;
+            vector<Value> _values;
+
+            static constexpr size_t smallObject { 16 };
+
+            // Stable insertion sort over both vectors, no allocation for the common small object.
+            void sortInPlace() {
+                for (size_t i = 1; i < _keys.size(); ++i) {
+                    for (size_t j = i; j > 0 && _keys[j] < _keys[j - 1]; --j) {
+                        swap(_keys[j], _keys[j - 1]);
+                        swap(_values[j], _values[j - 1]);
+                    }
+                }
+
+                size_t count { 0 };
+                for (size_t i = 0; i < _keys.size(); ++i) {
+                    if (count > 0 && _keys[count - 1] == _keys[i]) {
+                        _values[count - 1] = move(_values[i]);
+                        continue;
+                    }
+                    if (count != i) {
+                        _keys[count] = _keys[i];
+                        _values[count] = move(_values[i]);
+                    }
+                    ++count;
+                }
+                _keys.erase(_keys.begin() + static_cast<ptrdiff_t>(count), _keys.end());
+                _values.erase(_values.begin() + static_cast<ptrdiff_t>(count), _values.end());
+            }
+
+            void sortByPermutation() {
+                vector<size_t> order { };
+                order.resize(_keys.size());
+                iota(order.begin(), order.end(), size_t { 0 });
+                stable_sort(order.begin(), order.end(), [this](size_t left, size_t right) {
+                    return _keys[left] < _keys[right];
+                });
+
+                vector<string_view> sortedKeys { };
+                vector<Value> sortedValues { };
+                sortedKeys.reserve(order.size());
+                sortedValues.reserve(order.size());
+                for (auto index : order) {
+                    if (!sortedKeys.empty() && sortedKeys.back() == _keys[index]) {
+                        sortedValues.back() = move(_values[index]);
+                    } else {
+                        sortedKeys.push_back(_keys[index]);
+                        sortedValues.push_back(move(_values[index]));
+                    }
+                }
+                _keys = move(sortedKeys);
+                _values = move(sortedValues);
+            }
+
+            size_t lowerBound(string_view key) const {
+                size_t first { 0 };
+                size_t count { _keys.size() };
+                while (count > 0) {
+                    size_t half { count / 2 };
+                    if (_keys[first + half] < key) {
+                        first += half + 1;
+                        count -= half + 1;
+                    } else {
+                        count = half;
+                    }
+                }
+                return first;
+            }
+
+        public:
+            class iterator {
+                private:
+                    const JsonObject* _object;
+                    size_t _index;
+
+                public:
+                    using iterator_concept = forward_iterator_tag;
+                    using value_type = pair<string_view, const Value&>;
+                    using difference_type = ptrdiff_t;
+
+                    iterator()
+                        : _object { nullptr },
+                          _index { 0 }
+                    {
+                    }
+
+                    iterator(const JsonObject* object, size_t index)
+                        : _object { object },
+                          _index { index }
+                    {
+                    }
+
+                    value_type operator*() const {
+                        return value_type { _object->_keys[_index], _object->_values[_index] };
+                    }
+
+                    iterator& operator++() {
+                        ++_index;
+                        return *this;
+                    }
+
+                    iterator operator++(int) {
+                        iterator copy { *this };
+                        ++_index;
+                        return copy;
+                    }
+
+                    bool operator==(const iterator& other) const {
+                        return _index == other._index;
+                    }
+            };
+
+            JsonObject()
+                : _table { },
+                  _keys { },
+                  _values { }
+            {
+            }
+
+            explicit JsonObject(shared_ptr<JsonKeyTable> table)
+                : _table { move(table) },
+                  _keys { },
+                  _values { }
+            {
+            }
+
+            // Builds an object from members in document order with a single sort; keys must be
+            // views into 'table'. Like insert_or_assign, the last of duplicate keys wins.
+            JsonObject(shared_ptr<JsonKeyTable> table, vector<string_view> keys, vector<Value> values)
+                : _table { move(table) },
+                  _keys { move(keys) },
+                  _values(move(values))  // not braces: a vector<JsonValue> converts to a JsonValue
+            {
+                auto unordered { adjacent_find(_keys.begin(), _keys.end(), [](string_view left, string_view right) {
+                    return left >= right;
+                }) };
+                if (unordered == _keys.end()) {
+                    return;
+                }
+
+                if (_keys.size() <= smallObject) {
+                    sortInPlace();
+                } else {
+                    sortByPermutation();
+                }
+            }
+
+            size_t size() const {
+                return _keys.size();
+            }
+
+            bool empty() const {
+                return _keys.empty();
+            }
+
+            void reserve(size_t count) {
+                _keys.reserve(count);
+                _values.reserve(count);
+            }
+
+            bool contains(string_view key) const {
+                size_t index { lowerBound(key) };
+                return index < _keys.size() && _keys[index] == key;
+            }
+
+            const Value& at(string_view key) const {
+                size_t index { lowerBound(key) };
+                if (index == _keys.size() || _keys[index] != key) {
+                    throw out_of_range { "JsonObject key not found" };
+                }
+                return _values[index];
+            }
+
+            void insert_or_assign(string_view key, Value value) {
+                // members usually arrive in document order, appending is the common case
+                size_t index { _keys.empty() || _keys.back() < key ? _keys.size() : lowerBound(key) };
+                if (index < _keys.size() && _keys[index] == key) {
+                    _values[index] = move(value);
+                    return;
+                }
+
+                if (!_table) {
+                    _table = make_shared<JsonKeyTable>();
+                }
+                _keys.insert(_keys.begin() + static_cast<ptrdiff_t>(index), _table->internShared(key));
+                _values.insert(_values.begin() + static_cast<ptrdiff_t>(index), move(value));
+            }
+
+            span<const string_view> keys() const {
+                return _keys;
+            }
+
+            span<const Value> values() const {
+                return _values;
+            }
+
+            iterator begin() const {
+                return iterator { this, 0 };
+            }
+
+            iterator end() const {
+                return iterator { this, _keys.size() };
+            }
+
+            bool operator==(const JsonObject& other) const {
+                return _keys == other._keys && _values == other._values;
+            }
+    };
+}
\ No newline at end of file
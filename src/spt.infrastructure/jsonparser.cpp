@@ -1,15 +1,29 @@
 export module spt.infrastructure:jsonparser;
 
 import std;
+import :jsonobject;
 import :jsonvalue;
+import :jsonscalars;
+import :jsonstructuralparser;
 
 namespace spt::infrastructure::text {
+    using std::atomic;
+    using std::count;
     using std::format;
     using std::isdigit;
     using std::isspace;
+    using std::make_shared;
+    using std::move;
     using std::runtime_error;
+    using std::shared_ptr;
     using std::string;
     using std::string_view;
+    using std::vector;
+
+    export enum class JsonEngine {
+        Structural, // two-stage SIMD structural index (default)
+        Classic     // byte-at-a-time recursive descent, kept for comparison
+    };
 
     export class JsonParser {
         private:        
@@ -17,12 +31,16 @@ namespace spt::infrastructure::text {
             size_t _position;
             size_t _line;
             size_t _column;
+            string _scratch;
+            shared_ptr<JsonKeyTable> _keys;
 
             JsonParser(string_view json)
                 : _json { json }, 
                   _position { 0 }, 
                   _line { 1 }, 
-                  _column { 1 } {
+                  _column { 1 },
+                  _scratch { },
+                  _keys { make_shared<JsonKeyTable>() } {
             }
 
             JsonValue parseValue() {
@@ -40,7 +58,7 @@ namespace spt::infrastructure::text {
                     case '[':
                         return parseArray();
                     case '"':
-                        return parseString();
+                        return JsonValue { string { parseString() } };
                     case 't':
                         return parseTrue();
                     case 'f':
@@ -61,12 +79,13 @@ namespace spt::infrastructure::text {
             JsonValue parseObject() {
                 expect('{');
 
-                JsonValue::json_object object { };
+                vector<string_view> keys { };
+                JsonValue::json_array values { };
                 
                 skipWhitespace();
                 if (peek() == '}') { // empty json object
                     consume();
-                    return JsonValue { object };
+                    return JsonValue { JsonValue::json_object { _keys } };
                 }
 
                 while (true) {
@@ -78,12 +97,10 @@ namespace spt::infrastructure::text {
                         };
                     }
 
-                    auto keyResult { parseString() };
-                    string key = keyResult.getString();
+                    keys.push_back(_keys->intern(parseString()));
                     skipWhitespace();
                     expect(':');
-                    auto valueResult { parseValue() };
-                    object[key] = valueResult;
+                    values.push_back(parseValue());
                     skipWhitespace();
 
                     auto next { peek() };
@@ -100,7 +117,7 @@ namespace spt::infrastructure::text {
                     }
                 }
 
-                return JsonValue { object };
+                return JsonValue { JsonValue::json_object { _keys, move(keys), move(values) } };
             }
 
             JsonValue parseArray() {
@@ -111,12 +128,11 @@ namespace spt::infrastructure::text {
                 skipWhitespace();
                 if (peek() == ']') {    // empty json array
                     consume();
-                    return JsonValue{ array };
+                    return JsonValue { move(array) };
                 }
 
                 while (true) {
-                    auto valueResult = parseValue();
-                    array.push_back(valueResult);
+                    array.push_back(parseValue());
                     skipWhitespace();
 
                     auto next { peek() };
@@ -133,63 +149,20 @@ namespace spt::infrastructure::text {
                     }
                 }
 
-                return JsonValue { array };
+                return JsonValue { move(array) };
             }
 
-            JsonValue parseString(){
-                string result { };
-    
-                expect('"');
-                while (!eof() && peek() != '"') {
-                    auto ch { consume() };
-                    if (ch == '\\') {
-                        if (eof()) {
-                            throw runtime_error {
-                                format("Unterminated string escape ({0}:{1})", _line, _column)
-                            };
-                        }
-
-                        auto escaped { consume() };
-                        switch (escaped) {
-                            case '"':  result += '"'; break;
-                            case '\\': result += '\\'; break;
-                            case '/':  result += '/'; break;
-                            case 'b':  result += '\b'; break;
-                            case 'f':  result += '\f'; break;
-                            case 'n':  result += '\n'; break;
-                            case 'r':  result += '\r'; break;
-                            case 't':  result += '\t'; break;
-                            case 'u': { // simplified unicode escape
-                                if (_position + 4 > _json.size()) {
-                                    throw runtime_error {
-                                        format("Invalid unicode escape ({0}:{1})", _line, _column)
-                                    };
-                                }
-                                string hex { };
-                                for (int i = 0; i < 4; ++i) {
-                                    hex += consume();
-                                }
-                                result += "\\u" + hex;  // just append the hex sequence instead of converting to UTF-8
-                                break;
-                            }
-                            default:
-                                throw runtime_error {
-                                    format("Invalid escape sequence '\\{0}' ({1}:{2})", escaped, _line, _column)
-                                };
-                        }
-                    } else {
-                        result += ch;
-                    }
-                }
-
-                if (eof()) {
-                    throw runtime_error {
-                        format("Unterminated string ({0}:{1})", _line, _column)
-                    };
+            // The returned view points into the input, or into '_scratch' when the string had
+            // escapes, and is only valid until the next string is parsed.
+            string_view parseString() {
+                if (peek() != '"') {
+                    expect('"');
                 }
-                expect('"');
 
-                return JsonValue { result };
+                size_t end { 0 };
+                auto result { JsonScalars::readString(_json, _position, _scratch, end) };
+                advance(end);
+                return result;
             }
 
             JsonValue parseNumber() {
@@ -239,10 +212,9 @@ namespace spt::infrastructure::text {
                     }
                 }
 
-                string numberStr {
-                    _json.substr(start, _position - start)
+                double number { 
+                    JsonScalars::readNumber(_json.substr(start, _position - start), 0) 
                 };
-                double number { std::stod(numberStr) };
 
                 return JsonValue { number };
             }
@@ -297,6 +269,19 @@ namespace spt::infrastructure::text {
                 }
             }
 
+            // Moves to 'end', keeping line and column in step with the skipped text.
+            void advance(size_t end) {
+                auto skipped { _json.substr(_position, end - _position) };
+                auto newline { skipped.rfind('\n') };
+                if (newline == string_view::npos) {
+                    _column += skipped.size();
+                } else {
+                    _line += static_cast<size_t>(count(skipped.begin(), skipped.end(), '\n'));
+                    _column = skipped.size() - newline;
+                }
+                _position = end;
+            }
+
             char peek() const {
                 if (eof()) {
                     return '\0';
@@ -337,8 +322,29 @@ namespace spt::infrastructure::text {
                 consume();
             }
 
+            static atomic<JsonEngine>& defaultEngine() {
+                static atomic<JsonEngine> value { JsonEngine::Structural };
+                return value;
+            }
+
         public:
+            static JsonEngine engine() {
+                return defaultEngine().load();
+            }
+
+            static void engine(JsonEngine value) {
+                defaultEngine().store(value);
+            }
+
             static JsonValue parse(string_view json) {
+                return parse(json, engine());
+            }
+
+            static JsonValue parse(string_view json, JsonEngine engine) {
+                if (engine == JsonEngine::Structural) {
+                    return JsonStructuralParser::parse(json);
+                }
+
                 JsonParser parser { json };
                 auto result = parser.parseValue();
                 parser.skipWhitespace();
@@ -351,4 +357,4 @@ namespace spt::infrastructure::text {
                 return result;
             }
     };
-}
+}
\ No newline at end of file
@@ -0,0 +1,336 @@
+export module spt.infrastructure:jsonscalars;
+
+#if defined(_M_X64) || defined(__x86_64__)
+import <immintrin.h>;
+#endif
+
+import std;
+import :jsonstructuralindex;
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SPT_JSON_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SPT_JSON_TARGET(isa)
+#else
+#define SPT_JSON_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace spt::infrastructure::text {
+    using std::array;
+    using std::countr_zero;
+    using std::errc;
+    using std::format;
+    using std::from_chars;
+    using std::runtime_error;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::uint32_t;
+    using std::uint64_t;
+
+    // Decoding of JSON strings, numbers and literals starting at a known offset, shared by every
+    // engine that navigates the structural index.
+    export class JsonScalars final {
+        private:
+            static constexpr array<double, 23> powersOfTen {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+
+            static int hexDigit(char ch) {
+                if (ch >= '0' && ch <= '9') {
+                    return ch - '0';
+                }
+                if (ch >= 'a' && ch <= 'f') {
+                    return ch - 'a' + 10;
+                }
+                if (ch >= 'A' && ch <= 'F') {
+                    return ch - 'A' + 10;
+                }
+                return -1;
+            }
+
+            // Reads the four hex digits of a \u escape starting at 'position'.
+            static uint32_t readHex4(string_view json, size_t position) {
+                if (position + 4 > json.size()) {
+                    throw error(json, "Invalid unicode escape", position);
+                }
+                uint32_t value { 0 };
+                for (size_t i = 0; i < 4; ++i) {
+                    auto digit { hexDigit(json[position + i]) };
+                    if (digit < 0) {
+                        throw error(json, "Invalid unicode escape", position);
+                    }
+                    value = (value << 4) | static_cast<uint32_t>(digit);
+                }
+                return value;
+            }
+
+            static void appendUtf8(string& out, uint32_t codepoint) {
+                if (codepoint < 0x80) {
+                    out += static_cast<char>(codepoint);
+                } else if (codepoint < 0x800) {
+                    out += static_cast<char>(0xC0 | (codepoint >> 6));
+                    out += static_cast<char>(0x80 | (codepoint & 0x3F));
+                } else if (codepoint < 0x10000) {
+                    out += static_cast<char>(0xE0 | (codepoint >> 12));
+                    out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (codepoint & 0x3F));
+                } else {
+                    out += static_cast<char>(0xF0 | (codepoint >> 18));
+                    out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (codepoint & 0x3F));
+                }
+            }
+
+            // Decodes the \u escape whose hex digits start at 'position', joining surrogate
+            // pairs, and returns the position after it.
+            static size_t readUnicodeEscape(string_view json, size_t position, string& out) {
+                uint32_t codepoint { readHex4(json, position) };
+                position += 4;
+                if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+                    throw error(json, "Unpaired unicode surrogate", position - 6);
+                }
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                    if (json.substr(position, 2) != "\\u") {
+                        throw error(json, "Unpaired unicode surrogate", position - 6);
+                    }
+                    uint32_t low { readHex4(json, position + 2) };
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        throw error(json, "Unpaired unicode surrogate", position - 6);
+                    }
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    position += 6;
+                }
+                appendUtf8(out, codepoint);
+                return position;
+            }
+
+#if defined(SPT_JSON_X86)
+            static size_t findQuoteOrBackslashSse2(string_view json, size_t position) {
+                const __m128i quote { _mm_set1_epi8('"') };
+                const __m128i backslash { _mm_set1_epi8('\\') };
+                for (; position + 16 <= json.size(); position += 16) {
+                    __m128i chunk { _mm_loadu_si128(reinterpret_cast<const __m128i*>(json.data() + position)) };
+                    __m128i hits { _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)) };
+                    auto mask { static_cast<uint32_t>(_mm_movemask_epi8(hits)) };
+                    if (mask != 0) {
+                        return position + countr_zero(mask);
+                    }
+                }
+                return json.find_first_of("\"\\", position);
+            }
+
+            SPT_JSON_TARGET("avx2")
+            static size_t findQuoteOrBackslashAvx2(string_view json, size_t position) {
+                const __m256i quote { _mm256_set1_epi8('"') };
+                const __m256i backslash { _mm256_set1_epi8('\\') };
+                for (; position + 32 <= json.size(); position += 32) {
+                    __m256i chunk { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(json.data() + position)) };
+                    __m256i hits { _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)) };
+                    auto mask { static_cast<uint32_t>(_mm256_movemask_epi8(hits)) };
+                    if (mask != 0) {
+                        return position + countr_zero(mask);
+                    }
+                }
+                return findQuoteOrBackslashSse2(json, position);
+            }
+#endif
+
+            // Finds the next quote or backslash a vector register at a time (SSE2 is part of x86-64, AVX2
+            // is used when the CPU has it); other targets fall back to the library search.
+            static size_t findQuoteOrBackslash(string_view json, size_t position) {
+#if defined(SPT_JSON_X86)
+                if (JsonStructuralIndex::detectedLevel() == SimdLevel::Avx2) {
+                    return findQuoteOrBackslashAvx2(json, position);
+                }
+                return findQuoteOrBackslashSse2(json, position);
+#else
+                return json.find_first_of("\"\\", position);
+#endif
+            }
+
+            static bool isDigit(string_view json, size_t position) {
+                return position < json.size() && json[position] >= '0' && json[position] <= '9';
+            }
+
+        public:
+            JsonScalars() = delete;
+
+            static runtime_error error(string_view json, string_view message, size_t position) {
+                auto [line, column] = JsonStructuralIndex::locate(json, position);
+                return runtime_error {
+                    format("{0} ({1}:{2})", message, line, column)
+                };
+            }
+
+            static bool isDelimiter(string_view json, size_t position) {
+                if (position >= json.size()) {
+                    return true;
+                }
+                switch (json[position]) {
+                    case ' ': case '\t': case '\n': case '\r':
+                    case ',': case ':': case '[': case ']': case '{': case '}':
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            // Reads the string whose opening quote is at 'start'. Strings without escapes are
+            // returned as a view into 'json'; otherwise they are decoded to UTF-8 into 'scratch'.
+            static string_view readString(string_view json, size_t start, string& scratch) {
+                size_t end { 0 };
+                return readString(json, start, scratch, end);
+            }
+
+            // As above, also setting 'end' to the position just past the closing quote.
+            static string_view readString(string_view json, size_t start, string& scratch, size_t& end) {
+                size_t position { start + 1 };
+                size_t special { findQuoteOrBackslash(json, position) };
+                if (special == string_view::npos) {
+                    throw error(json, "Unterminated string", json.size());
+                }
+                if (json[special] == '"') {
+                    end = special + 1;
+                    return json.substr(position, special - position);
+                }
+
+                scratch.assign(json.substr(position, special - position));
+                position = special;
+                while (json[position] == '\\') {
+                    if (++position >= json.size()) {
+                        throw error(json, "Unterminated string escape", position);
+                    }
+                    auto escaped { json[position++] };
+                    switch (escaped) {
+                        case '"':  scratch += '"'; break;
+                        case '\\': scratch += '\\'; break;
+                        case '/':  scratch += '/'; break;
+                        case 'b':  scratch += '\b'; break;
+                        case 'f':  scratch += '\f'; break;
+                        case 'n':  scratch += '\n'; break;
+                        case 'r':  scratch += '\r'; break;
+                        case 't':  scratch += '\t'; break;
+                        case 'u':
+                            position = readUnicodeEscape(json, position, scratch);
+                            break;
+                        default:
+                            throw error(json, format("Invalid escape sequence '\\{0}'", escaped), position);
+                    }
+
+                    special = findQuoteOrBackslash(json, position);
+                    if (special == string_view::npos) {
+                        throw error(json, "Unterminated string", json.size());
+                    }
+                    scratch.append(json.substr(position, special - position));
+                    position = special;
+                }
+
+                end = position + 1;
+                return scratch;
+            }
+
+            // Parses and validates the number at 'start'. Up to 19 significant digits with a small
+            // decimal exponent are converted exactly in registers (Clinger's fast path); anything
+            // else goes through std::from_chars. Neither allocates nor depends on the locale.
+            static double readNumber(string_view json, size_t start) {
+                size_t position { start };
+                bool negative { false };
+                uint64_t mantissa { 0 };
+                int digits { 0 };
+                int exponent { 0 };
+                bool exact { true };
+
+                auto accumulate = [&](char ch) {
+                    if (digits < 19) {
+                        mantissa = mantissa * 10 + static_cast<uint64_t>(ch - '0');
+                        if (mantissa != 0) {
+                            ++digits;
+                        }
+                        return true;
+                    }
+                    exact = false;
+                    return false;
+                };
+
+                if (position < json.size() && json[position] == '-') {
+                    negative = true;
+                    ++position;
+                }
+                if (!isDigit(json, position)) {
+                    throw error(json, "Invalid number format", position);
+                }
+
+                if (json[position] == '0') {
+                    ++position;
+                } else {
+                    while (isDigit(json, position)) {
+                        if (!accumulate(json[position])) {
+                            ++exponent;
+                        }
+                        ++position;
+                    }
+                }
+
+                if (position < json.size() && json[position] == '.') {
+                    ++position;
+                    if (!isDigit(json, position)) {
+                        throw error(json, "Invalid number format: expected digit after '.'", position);
+                    }
+                    while (isDigit(json, position)) {
+                        if (accumulate(json[position])) {
+                            --exponent;
+                        }
+                        ++position;
+                    }
+                }
+
+                if (position < json.size() && (json[position] == 'e' || json[position] == 'E')) {
+                    ++position;
+                    bool negativeExponent { false };
+                    if (position < json.size() && (json[position] == '+' || json[position] == '-')) {
+                        negativeExponent = json[position] == '-';
+                        ++position;
+                    }
+                    if (!isDigit(json, position)) {
+                        throw error(json, "Invalid number format: expected digit in exponent", position);
+                    }
+                    int value { 0 };
+                    while (isDigit(json, position)) {
+                        if (value < 10000) {
+                            value = value * 10 + (json[position] - '0');
+                        }
+                        ++position;
+                    }
+                    exponent += negativeExponent ? -value : value;
+                }
+
+                if (!isDelimiter(json, position)) {
+                    throw error(json, "Invalid number format", position);
+                }
+
+                constexpr uint64_t maxExactMantissa { uint64_t { 1 } << 53 };
+                if (exact && mantissa <= maxExactMantissa && exponent >= -22 && exponent <= 22) {
+                    double value { static_cast<double>(mantissa) };
+                    value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+                    return negative ? -value : value;
+                }
+
+                double value { 0.0 };
+                auto [end, ec] = from_chars(json.data() + start, json.data() + position, value);
+                if (ec != errc { } || end != json.data() + position) {
+                    throw error(json, "Number out of range", start);
+                }
+                return value;
+            }
+
+            static void readLiteral(string_view json, size_t start, string_view literal) {
+                if (json.substr(start, literal.size()) != literal || !isDelimiter(json, start + literal.size())) {
+                    throw error(json, format("Invalid literal: expected '{0}'", literal), start);
+                }
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,344 @@
+export module spt.infrastructure:jsonstreamparser;
+
+import std;
+import :jsonhandler;
+import :jsonscalars;
+
+namespace spt::infrastructure::text {
+    using std::count;
+    using std::format;
+    using std::runtime_error;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    // Resumable push parser: input arrives in arbitrary chunks through feed() and is reported
+    // to a JsonHandler as soon as each token is complete. Only a token that straddles two
+    // chunks is buffered, so memory is bounded by the largest token rather than the payload.
+    export class JsonStreamParser final {
+        private:
+            enum class Expect {
+                Value,
+                FirstValueOrEnd,
+                FirstKeyOrEnd,
+                Key,
+                Colon,
+                CommaOrEnd,
+                Done
+            };
+
+            enum class Token {
+                None,
+                String,
+                Number,
+                Literal
+            };
+
+            JsonHandler& _handler;
+            vector<char> _containers;
+            Expect _expect;
+            Token _token;
+            bool _tokenIsKey;
+            bool _escaped;
+            bool _hasEscapes;
+            string _pending;
+            string _scratch;
+            size_t _offset;
+            size_t _line;
+            size_t _lineStart;
+
+            runtime_error error(string_view message, string_view chunk, size_t position) const {
+                auto before { chunk.substr(0, position) };
+                size_t line { _line + static_cast<size_t>(count(before.begin(), before.end(), '\n')) };
+                size_t lastNewline { before.rfind('\n') };
+                size_t lineStart { lastNewline == string_view::npos ? _lineStart : _offset + lastNewline + 1 };
+                return runtime_error {
+                    format("{0} ({1}:{2})", message, line, _offset + position - lineStart + 1)
+                };
+            }
+
+            static bool isWhitespace(char ch) {
+                return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+            }
+
+            static bool isNumberChar(char ch) {
+                return (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.' || ch == 'e' || ch == 'E';
+            }
+
+            static bool isLiteralChar(char ch) {
+                return ch >= 'a' && ch <= 'z';
+            }
+
+            // The token text, either straight from the chunk or joined with earlier chunks.
+            string_view tokenText(string_view chunk, size_t start, size_t end) {
+                if (_pending.empty()) {
+                    return chunk.substr(start, end - start);
+                }
+                _pending.append(chunk.substr(start, end - start));
+                return _pending;
+            }
+
+            void afterValue() {
+                _expect = _containers.empty() ? Expect::Done : Expect::CommaOrEnd;
+            }
+
+            void endContainer() {
+                auto open { _containers.back() };
+                _containers.pop_back();
+                if (open == '{') {
+                    _handler.onEndObject();
+                } else {
+                    _handler.onEndArray();
+                }
+                afterValue();
+            }
+
+            size_t beginToken(Token token, string_view chunk, size_t position) {
+                _token = token;
+                _tokenIsKey = _expect == Expect::Key || _expect == Expect::FirstKeyOrEnd;
+                _escaped = false;
+                _hasEscapes = false;
+                _pending.clear();
+                return resume(chunk, position, position + (token == Token::String ? 1 : 0));
+            }
+
+            size_t resume(string_view chunk, size_t start, size_t from) {
+                switch (_token) {
+                    case Token::String:
+                        return scanString(chunk, start, from);
+                    case Token::Number:
+                        return scanNumber(chunk, start, from);
+                    default:
+                        return scanLiteral(chunk, start, from);
+                }
+            }
+
+            size_t scanString(string_view chunk, size_t start, size_t from) {
+                size_t position { from };
+                if (_escaped && position < chunk.size()) {
+                    _escaped = false;
+                    ++position;
+                }
+
+                while (true) {
+                    position = chunk.find_first_of("\"\\", position);
+                    if (position == string_view::npos) {
+                        _pending.append(chunk.substr(start));
+                        return chunk.size();
+                    }
+                    if (chunk[position] == '\\') {
+                        _hasEscapes = true;
+                        if (position + 1 >= chunk.size()) {
+                            _escaped = true;
+                            _pending.append(chunk.substr(start));
+                            return chunk.size();
+                        }
+                        position += 2;
+                        continue;
+                    }
+                    break;
+                }
+
+                string_view raw { tokenText(chunk, start, position + 1) };
+                string_view text { raw.substr(1, raw.size() - 2) };
+                if (_hasEscapes) {
+                    try {
+                        text = JsonScalars::readString(raw, 0, _scratch);
+                    } catch (const runtime_error&) {
+                        throw error("Invalid escape sequence in string", chunk, position);
+                    }
+                }
+
+                _token = Token::None;
+                if (_tokenIsKey) {
+                    _handler.onKey(text);
+                    _expect = Expect::Colon;
+                } else {
+                    _handler.onString(text);
+                    afterValue();
+                }
+                return position + 1;
+            }
+
+            size_t scanNumber(string_view chunk, size_t start, size_t from) {
+                size_t position { from };
+                while (position < chunk.size() && isNumberChar(chunk[position])) {
+                    ++position;
+                }
+                if (position == chunk.size()) {
+                    _pending.append(chunk.substr(start));
+                    return position;
+                }
+                completeNumber(tokenText(chunk, start, position), chunk, position);
+                return position;
+            }
+
+            void completeNumber(string_view text, string_view chunk, size_t position) {
+                double value { 0.0 };
+                try {
+                    value = JsonScalars::readNumber(text, 0);
+                } catch (const runtime_error&) {
+                    throw error("Invalid number format", chunk, position);
+                }
+                _token = Token::None;
+                _handler.onNumber(value);
+                afterValue();
+            }
+
+            size_t scanLiteral(string_view chunk, size_t start, size_t from) {
+                size_t position { from };
+                while (position < chunk.size() && isLiteralChar(chunk[position])) {
+                    ++position;
+                }
+                if (position == chunk.size()) {
+                    _pending.append(chunk.substr(start));
+                    return position;
+                }
+                completeLiteral(tokenText(chunk, start, position), chunk, position);
+                return position;
+            }
+
+            void completeLiteral(string_view text, string_view chunk, size_t position) {
+                if (text == "true") {
+                    _handler.onBoolean(true);
+                } else if (text == "false") {
+                    _handler.onBoolean(false);
+                } else if (text == "null") {
+                    _handler.onNull();
+                } else {
+                    throw error(format("Invalid literal '{0}'", text), chunk, position);
+                }
+                _token = Token::None;
+                afterValue();
+            }
+
+            size_t dispatch(string_view chunk, size_t position) {
+                auto ch { chunk[position] };
+                switch (_expect) {
+                    case Expect::Done:
+                        throw error("Unexpected JSON content: end of file was expected", chunk, position);
+                    case Expect::Colon:
+                        if (ch != ':') {
+                            throw error("Expected ':' after object key", chunk, position);
+                        }
+                        _expect = Expect::Value;
+                        return position + 1;
+                    case Expect::CommaOrEnd: {
+                        auto open { _containers.back() };
+                        if (ch == ',') {
+                            _expect = open == '{' ? Expect::Key : Expect::Value;
+                        } else if ((open == '{' && ch == '}') || (open == '[' && ch == ']')) {
+                            endContainer();
+                        } else {
+                            throw error(open == '{' ? "Expected ',' or '}' in object" : "Expected ',' or ']' in array", chunk, position);
+                        }
+                        return position + 1;
+                    }
+                    case Expect::FirstKeyOrEnd:
+                    case Expect::Key:
+                        if (ch == '}' && _expect == Expect::FirstKeyOrEnd) {
+                            endContainer();
+                            return position + 1;
+                        }
+                        if (ch != '"') {
+                            throw error("Expected string key in object", chunk, position);
+                        }
+                        return beginToken(Token::String, chunk, position);
+                    case Expect::FirstValueOrEnd:
+                        if (ch == ']') {
+                            endContainer();
+                            return position + 1;
+                        }
+                        [[fallthrough]];
+                    case Expect::Value:
+                    default:
+                        break;
+                }
+
+                switch (ch) {
+                    case '{':
+                        _handler.onStartObject();
+                        _containers.push_back('{');
+                        _expect = Expect::FirstKeyOrEnd;
+                        return position + 1;
+                    case '[':
+                        _handler.onStartArray();
+                        _containers.push_back('[');
+                        _expect = Expect::FirstValueOrEnd;
+                        return position + 1;
+                    case '"':
+                        return beginToken(Token::String, chunk, position);
+                    case 't':
+                    case 'f':
+                    case 'n':
+                        return beginToken(Token::Literal, chunk, position);
+                    case '-':
+                    case '0': case '1': case '2': case '3': case '4':
+                    case '5': case '6': case '7': case '8': case '9':
+                        return beginToken(Token::Number, chunk, position);
+                    default:
+                        throw error(format("Unexpected character '{0}'", ch), chunk, position);
+                }
+            }
+
+        public:
+            explicit JsonStreamParser(JsonHandler& handler)
+                : _handler { handler },
+                  _containers { },
+                  _expect { Expect::Value },
+                  _token { Token::None },
+                  _tokenIsKey { false },
+                  _escaped { false },
+                  _hasEscapes { false },
+                  _pending { },
+                  _scratch { },
+                  _offset { 0 },
+                  _line { 1 },
+                  _lineStart { 0 }
+            {
+            }
+
+            JsonStreamParser(const JsonStreamParser&) = delete;
+            JsonStreamParser& operator=(const JsonStreamParser&) = delete;
+
+            bool done() const {
+                return _expect == Expect::Done && _token == Token::None;
+            }
+
+            void feed(string_view chunk) {
+                size_t position { 0 };
+                if (_token != Token::None && !chunk.empty()) {
+                    position = resume(chunk, 0, 0);
+                }
+
+                while (position < chunk.size()) {
+                    if (isWhitespace(chunk[position])) {
+                        ++position;
+                    } else {
+                        position = dispatch(chunk, position);
+                    }
+                }
+
+                for (size_t newline = chunk.find('\n'); newline != string_view::npos; newline = chunk.find('\n', newline + 1)) {
+                    ++_line;
+                    _lineStart = _offset + newline + 1;
+                }
+                _offset += chunk.size();
+            }
+
+            void finish() {
+                if (_token == Token::Number) {
+                    completeNumber(_pending, { }, 0);
+                } else if (_token == Token::Literal) {
+                    completeLiteral(_pending, { }, 0);
+                } else if (_token == Token::String) {
+                    throw error("Unterminated string", { }, 0);
+                }
+
+                if (_expect != Expect::Done) {
+                    throw error("Unexpected end of input", { }, 0);
+                }
+            }
+    };
+}
\ No newline at end of file
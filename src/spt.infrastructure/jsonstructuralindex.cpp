@@ -0,0 +1,335 @@
+export module spt.infrastructure:jsonstructuralindex;
+
+#if defined(_M_X64) || defined(__x86_64__)
+import <immintrin.h>;
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+import <intrin.h>;
+#endif
+
+import std;
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SPT_JSON_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SPT_JSON_TARGET(isa)
+#else
+#define SPT_JSON_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace spt::infrastructure::text {
+    using std::array;
+    using std::copy_n;
+    using std::countr_zero;
+    using std::fill_n;
+    using std::format;
+    using std::int64_t;
+    using std::length_error;
+    using std::min;
+    using std::numeric_limits;
+    using std::pair;
+    using std::size_t;
+    using std::span;
+    using std::string_view;
+    using std::uint32_t;
+    using std::uint64_t;
+    using std::vector;
+
+    export enum class SimdLevel {
+        Scalar,
+        Sse42,
+        Avx2
+    };
+
+    // Stage one of the structural parser: classifies the input in 64-byte blocks and records the
+    // offset of every structural character ({ } [ ] : ,), every opening quote and the first byte
+    // of every scalar that lies outside a string. Stage two only visits these offsets.
+    export class JsonStructuralIndex final {
+        private:
+            struct BlockMasks {
+                uint64_t quote;
+                uint64_t backslash;
+                uint64_t op;
+                uint64_t whitespace;
+            };
+
+            using classifier_t = BlockMasks (*)(const char*);
+
+            static constexpr size_t BlockSize { 64 };
+
+            vector<uint32_t> _positions;
+            SimdLevel _level;
+
+            explicit JsonStructuralIndex(SimdLevel level)
+                : _positions { },
+                  _level { level }
+            {
+            }
+
+            static BlockMasks classifyScalar(const char* block) {
+                BlockMasks masks { };
+                for (size_t i = 0; i < BlockSize; ++i) {
+                    uint64_t bit { uint64_t { 1 } << i };
+                    switch (block[i]) {
+                        case '"':
+                            masks.quote |= bit;
+                            break;
+                        case '\\':
+                            masks.backslash |= bit;
+                            break;
+                        case '{': case '}': case '[': case ']': case ':': case ',':
+                            masks.op |= bit;
+                            break;
+                        case ' ': case '\t': case '\n': case '\r':
+                            masks.whitespace |= bit;
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                return masks;
+            }
+
+#if defined(SPT_JSON_X86)
+            SPT_JSON_TARGET("sse4.2")
+            static BlockMasks classifySse42(const char* block) {
+                const __m128i quote { _mm_set1_epi8('"') };
+                const __m128i backslash { _mm_set1_epi8('\\') };
+                const __m128i ops { _mm_setr_epi8('{', '}', '[', ']', ':', ',', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) };
+                const __m128i spaces { _mm_setr_epi8(' ', '\t', '\n', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) };
+                constexpr int mode { _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK };
+
+                BlockMasks masks { };
+                for (size_t i = 0; i < BlockSize; i += 16) {
+                    __m128i chunk { _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i)) };
+                    masks.quote |= uint64_t { static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote))) } << i;
+                    masks.backslash |= uint64_t { static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash))) } << i;
+                    masks.op |= uint64_t { static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_cmpestrm(ops, 6, chunk, 16, mode))) } << i;
+                    masks.whitespace |= uint64_t { static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_cmpestrm(spaces, 4, chunk, 16, mode))) } << i;
+                }
+                return masks;
+            }
+
+            SPT_JSON_TARGET("avx2")
+            static BlockMasks classifyAvx2(const char* block) {
+                const __m256i quote { _mm256_set1_epi8('"') };
+                const __m256i backslash { _mm256_set1_epi8('\\') };
+                const __m256i caseBit { _mm256_set1_epi8(0x20) };
+                const __m256i openBrace { _mm256_set1_epi8('{') };   // '[' | 0x20 == '{'
+                const __m256i closeBrace { _mm256_set1_epi8('}') };  // ']' | 0x20 == '}'
+                const __m256i colon { _mm256_set1_epi8(':') };
+                const __m256i comma { _mm256_set1_epi8(',') };
+                const __m256i space { _mm256_set1_epi8(' ') };
+                const __m256i tab { _mm256_set1_epi8('\t') };
+                const __m256i newline { _mm256_set1_epi8('\n') };
+                const __m256i carriage { _mm256_set1_epi8('\r') };
+
+                BlockMasks masks { };
+                for (size_t i = 0; i < BlockSize; i += 32) {
+                    __m256i chunk { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i)) };
+                    __m256i folded { _mm256_or_si256(chunk, caseBit) };
+                    __m256i op {
+                        _mm256_or_si256(
+                            _mm256_or_si256(_mm256_cmpeq_epi8(folded, openBrace), _mm256_cmpeq_epi8(folded, closeBrace)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma))
+                        )
+                    };
+                    __m256i whitespace {
+                        _mm256_or_si256(
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, carriage))
+                        )
+                    };
+                    masks.quote |= uint64_t { static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote))) } << i;
+                    masks.backslash |= uint64_t { static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash))) } << i;
+                    masks.op |= uint64_t { static_cast<uint32_t>(_mm256_movemask_epi8(op)) } << i;
+                    masks.whitespace |= uint64_t { static_cast<uint32_t>(_mm256_movemask_epi8(whitespace)) } << i;
+                }
+                return masks;
+            }
+
+            static array<uint32_t, 4> cpuid(uint32_t leaf, uint32_t subleaf) {
+#if defined(_MSC_VER) && !defined(__clang__)
+                int regs[4] { };
+                __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+                return {
+                    static_cast<uint32_t>(regs[0]),
+                    static_cast<uint32_t>(regs[1]),
+                    static_cast<uint32_t>(regs[2]),
+                    static_cast<uint32_t>(regs[3])
+                };
+#else
+                uint32_t a, b, c, d;
+                __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(subleaf));
+                return { a, b, c, d };
+#endif
+            }
+
+            static uint64_t xgetbv() {
+#if defined(_MSC_VER) && !defined(__clang__)
+                return _xgetbv(0);
+#else
+                uint32_t low, high;
+                __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+                return (uint64_t { high } << 32) | low;
+#endif
+            }
+#endif
+
+            static SimdLevel detect() {
+#if defined(SPT_JSON_X86)
+                auto maxLeaf { cpuid(0, 0)[0] };
+                auto features { cpuid(1, 0) };
+                bool sse42 { ((features[2] >> 20) & 1) != 0 };
+                bool osxsave { ((features[2] >> 27) & 1) != 0 };
+                bool avx { ((features[2] >> 28) & 1) != 0 };
+                bool ymmEnabled { osxsave && avx && (xgetbv() & 0x6) == 0x6 };
+                bool avx2 { ymmEnabled && maxLeaf >= 7 && ((cpuid(7, 0)[1] >> 5) & 1) != 0 };
+                if (avx2) {
+                    return SimdLevel::Avx2;
+                }
+                if (sse42) {
+                    return SimdLevel::Sse42;
+                }
+#endif
+                return SimdLevel::Scalar;
+            }
+
+            static classifier_t classifierFor(SimdLevel level) {
+#if defined(SPT_JSON_X86)
+                switch (level) {
+                    case SimdLevel::Avx2:
+                        return &classifyAvx2;
+                    case SimdLevel::Sse42:
+                        return &classifySse42;
+                    default:
+                        break;
+                }
+#endif
+                return &classifyScalar;
+            }
+
+            // Marks every character that follows an odd-length run of backslashes, carrying runs
+            // that straddle two blocks through 'prevEndsOdd'.
+            static uint64_t escapedCharacters(uint64_t backslash, uint64_t& prevEndsOdd) {
+                constexpr uint64_t evenBits { 0x5555555555555555ULL };
+                constexpr uint64_t oddBits { ~evenBits };
+
+                uint64_t startEdges { backslash & ~(backslash << 1) };
+                uint64_t evenStartMask { evenBits ^ prevEndsOdd };
+                uint64_t evenStarts { startEdges & evenStartMask };
+                uint64_t oddStarts { startEdges & ~evenStartMask };
+                uint64_t evenCarries { backslash + evenStarts };
+                uint64_t oddCarries { backslash + oddStarts };
+                bool endsOdd { oddCarries < backslash };
+                oddCarries |= prevEndsOdd;
+                prevEndsOdd = endsOdd ? 1 : 0;
+
+                uint64_t evenCarryEnds { evenCarries & ~backslash };
+                uint64_t oddCarryEnds { oddCarries & ~backslash };
+                return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+            }
+
+            static uint64_t prefixXor(uint64_t bits) {
+                bits ^= bits << 1;
+                bits ^= bits << 2;
+                bits ^= bits << 4;
+                bits ^= bits << 8;
+                bits ^= bits << 16;
+                bits ^= bits << 32;
+                return bits;
+            }
+
+            void flatten(uint64_t bits, size_t offset) {
+                while (bits != 0) {
+                    _positions.push_back(static_cast<uint32_t>(offset + countr_zero(bits)));
+                    bits &= bits - 1;
+                }
+            }
+
+        public:
+            static SimdLevel detectedLevel() {
+                static const SimdLevel level { detect() };
+                return level;
+            }
+
+            static JsonStructuralIndex build(string_view json) {
+                return build(json, detectedLevel());
+            }
+
+            static JsonStructuralIndex build(string_view json, SimdLevel level) {
+                if (json.size() > numeric_limits<uint32_t>::max()) {
+                    throw length_error {
+                        format("JSON input of {0} bytes exceeds the structural index limit", json.size())
+                    };
+                }
+
+                // never run an instruction set the processor does not have
+                JsonStructuralIndex index { min(level, detectedLevel()) };
+                index._positions.reserve(json.size() / 8 + 16);
+                classifier_t classify { classifierFor(index._level) };
+
+                uint64_t prevEndsOdd { 0 };
+                uint64_t prevInString { 0 };
+                uint64_t prevScalar { 0 };
+                char padded[BlockSize];
+
+                for (size_t offset = 0; offset < json.size(); offset += BlockSize) {
+                    const char* block { json.data() + offset };
+                    size_t remaining { json.size() - offset };
+                    if (remaining < BlockSize) {
+                        fill_n(padded, BlockSize, ' ');
+                        copy_n(block, remaining, padded);
+                        block = padded;
+                    }
+
+                    BlockMasks masks { classify(block) };
+                    uint64_t quotes { masks.quote & ~escapedCharacters(masks.backslash, prevEndsOdd) };
+                    uint64_t inString { prefixXor(quotes) ^ prevInString };
+                    prevInString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+                    uint64_t scalars { ~(masks.op | masks.whitespace | masks.quote) & ~inString };
+                    uint64_t scalarStarts { scalars & ~((scalars << 1) | prevScalar) };
+                    prevScalar = scalars >> 63;
+
+                    index.flatten((masks.op & ~inString) | (quotes & inString) | scalarStarts, offset);
+                }
+
+                return index;
+            }
+
+            // Line and column are only needed to report errors, so they are recomputed on demand
+            // instead of being tracked for every byte consumed.
+            static pair<size_t, size_t> locate(string_view json, size_t position) {
+                size_t line { 1 };
+                size_t column { 1 };
+                size_t end { min(position, json.size()) };
+                for (size_t i = 0; i < end; ++i) {
+                    if (json[i] == '\n') {
+                        ++line;
+                        column = 1;
+                    } else {
+                        ++column;
+                    }
+                }
+                return { line, column };
+            }
+
+            SimdLevel level() const {
+                return _level;
+            }
+
+            size_t size() const {
+                return _positions.size();
+            }
+
+            span<const uint32_t> positions() const {
+                return _positions;
+            }
+
+            uint32_t operator[](size_t index) const {
+                return _positions[index];
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+export module spt.infrastructure:jsonstructuralparser;
+
+import std;
+import :jsonobject;
+import :jsonvalue;
+import :jsonscalars;
+import :jsonstructuralindex;
+
+namespace spt::infrastructure::text {
+    using std::format;
+    using std::make_shared;
+    using std::move;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::span;
+    using std::string;
+    using std::string_view;
+    using std::uint32_t;
+    using std::vector;
+
+    // Stage two of the structural parser: walks the offsets produced by JsonStructuralIndex and
+    // materializes a JsonValue. Whitespace is never visited, and line/column information is only
+    // computed when an error is raised.
+    export class JsonStructuralParser final {
+        private:
+            string_view _json;
+            span<const uint32_t> _positions;
+            size_t _next;
+            string _scratch;
+            shared_ptr<JsonKeyTable> _keys;
+
+            JsonStructuralParser(string_view json, span<const uint32_t> positions)
+                : _json { json },
+                  _positions { positions },
+                  _next { 0 },
+                  _scratch { },
+                  _keys { make_shared<JsonKeyTable>() }
+            {
+            }
+
+            runtime_error error(string_view message, size_t position) const {
+                return JsonScalars::error(_json, message, position);
+            }
+
+            bool done() const {
+                return _next >= _positions.size();
+            }
+
+            size_t position() const {
+                return done() ? _json.size() : _positions[_next];
+            }
+
+            char current() const {
+                return done() ? '\0' : _json[_positions[_next]];
+            }
+
+            JsonValue parseValue() {
+                if (done()) {
+                    throw error("Unexpected end of input", _json.size());
+                }
+
+                size_t start { _positions[_next++] };
+                auto ch { _json[start] };
+                switch (ch) {
+                    case '{':
+                        return parseObject();
+                    case '[':
+                        return parseArray();
+                    case '"':
+                        return JsonValue { string { JsonScalars::readString(_json, start, _scratch) } };
+                    case 't':
+                        JsonScalars::readLiteral(_json, start, "true");
+                        return JsonValue { true };
+                    case 'f':
+                        JsonScalars::readLiteral(_json, start, "false");
+                        return JsonValue { false };
+                    case 'n':
+                        JsonScalars::readLiteral(_json, start, "null");
+                        return JsonValue { };
+                    case '-':
+                    case '0': case '1': case '2': case '3': case '4':
+                    case '5': case '6': case '7': case '8': case '9':
+                        return JsonValue { JsonScalars::readNumber(_json, start) };
+                    default:
+                        throw error(format("Unexpected character '{0}'", ch), start);
+                }
+            }
+
+            JsonValue parseObject() {
+                vector<string_view> keys { };
+                JsonValue::json_array values { };
+
+                if (current() == '}') { // empty json object
+                    ++_next;
+                    return JsonValue { JsonValue::json_object { _keys } };
+                }
+
+                while (true) {
+                    if (current() != '"') {
+                        throw error("Expected string key in object", position());
+                    }
+
+                    // interned before the value is parsed, which reuses the scratch buffer
+                    keys.push_back(_keys->intern(JsonScalars::readString(_json, _positions[_next++], _scratch)));
+                    if (current() != ':') {
+                        throw error("Expected ':' after object key", position());
+                    }
+                    ++_next;
+                    values.push_back(parseValue());
+
+                    auto next { current() };
+                    if (next == '}') {
+                        ++_next;
+                        break;
+                    } else if (next == ',') {
+                        ++_next;
+                    } else {
+                        throw error("Expected ',' or '}' in object", position());
+                    }
+                }
+
+                return JsonValue { JsonValue::json_object { _keys, move(keys), move(values) } };
+            }
+
+            JsonValue parseArray() {
+                JsonValue::json_array array { };
+
+                if (current() == ']') { // empty json array
+                    ++_next;
+                    return JsonValue { move(array) };
+                }
+
+                while (true) {
+                    array.push_back(parseValue());
+
+                    auto next { current() };
+                    if (next == ']') {
+                        ++_next;
+                        break;
+                    } else if (next == ',') {
+                        ++_next;
+                    } else {
+                        throw error("Expected ',' or ']' in array", position());
+                    }
+                }
+
+                return JsonValue { move(array) };
+            }
+
+        public:
+            static JsonValue parse(string_view json) {
+                return parse(json, JsonStructuralIndex::detectedLevel());
+            }
+
+            static JsonValue parse(string_view json, SimdLevel level) {
+                JsonStructuralIndex index { JsonStructuralIndex::build(json, level) };
+                return parse(json, index.positions());
+            }
+
+            // Materializes exactly one value from an already built index; 'positions' may be a
+            // sub-range covering a single nested value.
+            static JsonValue parse(string_view json, span<const uint32_t> positions) {
+                JsonStructuralParser parser { json, positions };
+                auto result = parser.parseValue();
+                if (!parser.done()) {
+                    throw parser.error("Unexpected JSON content: end of file was expected", parser.position());
+                }
+
+                return result;
+            }
+    };
+}
\ No newline at end of file
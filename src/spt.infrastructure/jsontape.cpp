@@ -0,0 +1,486 @@
+export module spt.infrastructure:jsontape;
+
+import std;
+import :jsonobject;
+import :jsonvalue;
+import :jsonscalars;
+import :jsonstructuralindex;
+
+namespace spt::infrastructure::text {
+    using std::bit_cast;
+    using std::copy_n;
+    using std::forward_iterator_tag;
+    using std::format;
+    using std::make_shared;
+    using std::make_unique;
+    using std::move;
+    using std::out_of_range;
+    using std::ptrdiff_t;
+    using std::runtime_error;
+    using std::shared_ptr;
+    using std::size_t;
+    using std::span;
+    using std::string;
+    using std::string_view;
+    using std::uint32_t;
+    using std::uint64_t;
+    using std::uint8_t;
+    using std::uintptr_t;
+    using std::unique_ptr;
+    using std::vector;
+    using std::pmr::monotonic_buffer_resource;
+    using std::pmr::polymorphic_allocator;
+
+    // Each tape word carries its kind in the top byte and a 56-bit payload:
+    //   Null, True, False       no payload
+    //   Number                  followed by one word holding the double bits
+    //   String                  payload is the length, followed by one word holding the address
+    //   ArrayStart, ObjectStart payload is the index of the matching end word
+    //   ArrayEnd, ObjectEnd     payload is the number of elements or members
+    // Object members are a String word (the key) followed by the member value.
+    export enum class JsonTapeKind : uint8_t {
+        Null,
+        True,
+        False,
+        Number,
+        String,
+        ArrayStart,
+        ArrayEnd,
+        ObjectStart,
+        ObjectEnd
+    };
+
+    export class JsonTapeValue final {
+        private:
+            span<const uint64_t> _tape;
+            size_t _index;
+
+            static constexpr uint64_t PayloadMask { (uint64_t { 1 } << 56) - 1 };
+
+            JsonTapeKind kind(size_t index) const {
+                return static_cast<JsonTapeKind>(_tape[index] >> 56);
+            }
+
+            uint64_t payload(size_t index) const {
+                return _tape[index] & PayloadMask;
+            }
+
+            // Index of the word after the value that starts at 'index'.
+            size_t after(size_t index) const {
+                switch (kind(index)) {
+                    case JsonTapeKind::Number:
+                    case JsonTapeKind::String:
+                        return index + 2;
+                    case JsonTapeKind::ArrayStart:
+                    case JsonTapeKind::ObjectStart:
+                        return static_cast<size_t>(payload(index)) + 1;
+                    default:
+                        return index + 1;
+                }
+            }
+
+            string_view stringAt(size_t index) const {
+                return string_view {
+                    reinterpret_cast<const char*>(static_cast<uintptr_t>(_tape[index + 1])),
+                    static_cast<size_t>(payload(index))
+                };
+            }
+
+            JsonTapeValue(span<const uint64_t> tape, size_t index)
+                : _tape { tape },
+                  _index { index }
+            {
+            }
+
+            JsonValue toValue(const shared_ptr<JsonKeyTable>& keys) const {
+                switch (kind()) {
+                    case JsonTapeKind::True:
+                        return JsonValue { true };
+                    case JsonTapeKind::False:
+                        return JsonValue { false };
+                    case JsonTapeKind::Number:
+                        return JsonValue { getNumber() };
+                    case JsonTapeKind::String:
+                        return JsonValue { string { getString() } };
+                    case JsonTapeKind::ArrayStart: {
+                        JsonValue::json_array array { };
+                        array.reserve(count());
+                        for (auto element : *this) {
+                            array.push_back(element.toValue(keys));
+                        }
+                        return JsonValue { move(array) };
+                    }
+                    case JsonTapeKind::ObjectStart: {
+                        vector<string_view> names { };
+                        JsonValue::json_array values { };
+                        size_t end { static_cast<size_t>(payload(_index)) };
+                        for (size_t index = _index + 1; index < end; index = after(index + 2)) {
+                            names.push_back(keys->intern(stringAt(index)));
+                            values.push_back(JsonTapeValue { _tape, index + 2 }.toValue(keys));
+                        }
+                        return JsonValue { JsonValue::json_object { keys, move(names), move(values) } };
+                    }
+                    default:
+                        return JsonValue { };
+                }
+            }
+
+            friend class JsonTape;
+
+        public:
+            class iterator {
+                private:
+                    span<const uint64_t> _tape;
+                    size_t _index;
+
+                public:
+                    using iterator_concept = forward_iterator_tag;
+                    using value_type = JsonTapeValue;
+                    using difference_type = ptrdiff_t;
+
+                    iterator()
+                        : _tape { },
+                          _index { 0 }
+                    {
+                    }
+
+                    iterator(span<const uint64_t> tape, size_t index)
+                        : _tape { tape },
+                          _index { index }
+                    {
+                    }
+
+                    JsonTapeValue operator*() const {
+                        return JsonTapeValue { _tape, _index };
+                    }
+
+                    iterator& operator++() {
+                        _index = JsonTapeValue { _tape, _index }.after(_index);
+                        return *this;
+                    }
+
+                    iterator operator++(int) {
+                        iterator copy { *this };
+                        ++*this;
+                        return copy;
+                    }
+
+                    bool operator==(const iterator& other) const {
+                        return _index == other._index;
+                    }
+            };
+
+            JsonTapeKind kind() const {
+                return kind(_index);
+            }
+
+            bool isNull() const {
+                return kind() == JsonTapeKind::Null;
+            }
+
+            bool isBoolean() const {
+                return kind() == JsonTapeKind::True || kind() == JsonTapeKind::False;
+            }
+
+            bool isNumber() const {
+                return kind() == JsonTapeKind::Number;
+            }
+
+            bool isString() const {
+                return kind() == JsonTapeKind::String;
+            }
+
+            bool isArray() const {
+                return kind() == JsonTapeKind::ArrayStart;
+            }
+
+            bool isObject() const {
+                return kind() == JsonTapeKind::ObjectStart;
+            }
+
+            bool getBoolean() const {
+                if (!isBoolean()) {
+                    throw runtime_error { "JsonTapeValue is not a boolean" };
+                }
+                return kind() == JsonTapeKind::True;
+            }
+
+            double getNumber() const {
+                if (!isNumber()) {
+                    throw runtime_error { "JsonTapeValue is not a number" };
+                }
+                return bit_cast<double>(_tape[_index + 1]);
+            }
+
+            string_view getString() const {
+                if (!isString()) {
+                    throw runtime_error { "JsonTapeValue is not a string" };
+                }
+                return stringAt(_index);
+            }
+
+            size_t count() const {
+                size_t result { 0 };
+                if (isArray() || isObject()) {
+                    result = static_cast<size_t>(payload(static_cast<size_t>(payload(_index))));
+                }
+                return result;
+            }
+
+            bool contains(string_view key) const {
+                if (!isObject()) {
+                    return false;
+                }
+                size_t end { static_cast<size_t>(payload(_index)) };
+                for (size_t index = _index + 1; index < end; index = after(index + 2)) {
+                    if (stringAt(index) == key) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            iterator begin() const {
+                if (!isArray()) {
+                    throw out_of_range { "Iteration requested on non-array JsonTapeValue" };
+                }
+                return iterator { _tape, _index + 1 };
+            }
+
+            iterator end() const {
+                if (!isArray()) {
+                    throw out_of_range { "Iteration requested on non-array JsonTapeValue" };
+                }
+                return iterator { _tape, static_cast<size_t>(payload(_index)) };
+            }
+
+            JsonTapeValue operator[](size_t index) const {
+                if (!isArray()) {
+                    throw out_of_range { "Indexing operator[] called on non-array JsonTapeValue" };
+                }
+                if (index >= count()) {
+                    throw out_of_range { "JsonTapeValue array index out of range" };
+                }
+                size_t current { _index + 1 };
+                for (; index > 0; --index) {
+                    current = after(current);
+                }
+                return JsonTapeValue { _tape, current };
+            }
+
+            JsonTapeValue operator[](string_view key) const {
+                if (!isObject()) {
+                    throw out_of_range { "Indexing operator[] called on non-object JsonTapeValue" };
+                }
+                size_t end { static_cast<size_t>(payload(_index)) };
+                for (size_t index = _index + 1; index < end; index = after(index + 2)) {
+                    if (stringAt(index) == key) {
+                        return JsonTapeValue { _tape, index + 2 };
+                    }
+                }
+                throw out_of_range { "JsonTapeValue object key not found" };
+            }
+
+            // Copies this value and everything below it into a standalone JsonValue.
+            JsonValue toValue() const {
+                return toValue(make_shared<JsonKeyTable>());
+            }
+    };
+
+    // A whole document flattened into one tape that lives in a per-parse monotonic arena. Strings
+    // without escapes are views into the source text, so the source must outlive the tape;
+    // escaped strings are decoded into the arena. Parsing performs a constant number of heap
+    // allocations and destroying the tape releases the arena at once.
+    export class JsonTape final {
+        private:
+            static constexpr uint64_t PayloadMask { (uint64_t { 1 } << 56) - 1 };
+
+            string_view _json;
+            unique_ptr<monotonic_buffer_resource> _arena;
+            vector<uint64_t, polymorphic_allocator<uint64_t>> _tape;
+
+            // built from the structural index; not part of the finished tape
+            span<const uint32_t> _positions;
+            size_t _next;
+            string _scratch;
+
+            JsonTape(string_view json, span<const uint32_t> positions)
+                : _json { json },
+                  _arena { make_unique<monotonic_buffer_resource>((positions.size() * 2 + 2) * sizeof(uint64_t) + 256) },
+                  _tape { _arena.get() },
+                  _positions { positions },
+                  _next { 0 },
+                  _scratch { }
+            {
+                // every structural slot yields at most two words, so the tape never reallocates
+                _tape.reserve(positions.size() * 2 + 2);
+            }
+
+            runtime_error error(string_view message, size_t position) const {
+                return JsonScalars::error(_json, message, position);
+            }
+
+            bool done() const {
+                return _next >= _positions.size();
+            }
+
+            size_t position() const {
+                return done() ? _json.size() : _positions[_next];
+            }
+
+            char current() const {
+                return done() ? '\0' : _json[_positions[_next]];
+            }
+
+            void append(JsonTapeKind kind, uint64_t payload = 0) {
+                _tape.push_back((static_cast<uint64_t>(kind) << 56) | (payload & PayloadMask));
+            }
+
+            void appendString(size_t start) {
+                string_view text { JsonScalars::readString(_json, start, _scratch) };
+                if (text.data() == _scratch.data()) {
+                    char* copy { static_cast<char*>(_arena->allocate(text.size(), 1)) };
+                    copy_n(text.data(), text.size(), copy);
+                    text = string_view { copy, text.size() };
+                }
+                append(JsonTapeKind::String, text.size());
+                _tape.push_back(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(text.data())));
+            }
+
+            void parseValue() {
+                if (done()) {
+                    throw error("Unexpected end of input", _json.size());
+                }
+
+                size_t start { _positions[_next++] };
+                auto ch { _json[start] };
+                switch (ch) {
+                    case '{':
+                        parseObject();
+                        break;
+                    case '[':
+                        parseArray();
+                        break;
+                    case '"':
+                        appendString(start);
+                        break;
+                    case 't':
+                        JsonScalars::readLiteral(_json, start, "true");
+                        append(JsonTapeKind::True);
+                        break;
+                    case 'f':
+                        JsonScalars::readLiteral(_json, start, "false");
+                        append(JsonTapeKind::False);
+                        break;
+                    case 'n':
+                        JsonScalars::readLiteral(_json, start, "null");
+                        append(JsonTapeKind::Null);
+                        break;
+                    case '-':
+                    case '0': case '1': case '2': case '3': case '4':
+                    case '5': case '6': case '7': case '8': case '9':
+                        append(JsonTapeKind::Number);
+                        _tape.push_back(bit_cast<uint64_t>(JsonScalars::readNumber(_json, start)));
+                        break;
+                    default:
+                        throw error(format("Unexpected character '{0}'", ch), start);
+                }
+            }
+
+            void parseObject() {
+                size_t open { _tape.size() };
+                append(JsonTapeKind::ObjectStart);
+                size_t members { 0 };
+
+                if (current() == '}') { // empty json object
+                    ++_next;
+                } else {
+                    while (true) {
+                        if (current() != '"') {
+                            throw error("Expected string key in object", position());
+                        }
+                        appendString(_positions[_next++]);
+                        if (current() != ':') {
+                            throw error("Expected ':' after object key", position());
+                        }
+                        ++_next;
+                        parseValue();
+                        ++members;
+
+                        auto next { current() };
+                        if (next == '}') {
+                            ++_next;
+                            break;
+                        } else if (next == ',') {
+                            ++_next;
+                        } else {
+                            throw error("Expected ',' or '}' in object", position());
+                        }
+                    }
+                }
+
+                _tape[open] |= _tape.size();
+                append(JsonTapeKind::ObjectEnd, members);
+            }
+
+            void parseArray() {
+                size_t open { _tape.size() };
+                append(JsonTapeKind::ArrayStart);
+                size_t elements { 0 };
+
+                if (current() == ']') { // empty json array
+                    ++_next;
+                } else {
+                    while (true) {
+                        parseValue();
+                        ++elements;
+
+                        auto next { current() };
+                        if (next == ']') {
+                            ++_next;
+                            break;
+                        } else if (next == ',') {
+                            ++_next;
+                        } else {
+                            throw error("Expected ',' or ']' in array", position());
+                        }
+                    }
+                }
+
+                _tape[open] |= _tape.size();
+                append(JsonTapeKind::ArrayEnd, elements);
+            }
+
+        public:
+            JsonTape(const JsonTape&) = delete;
+            JsonTape(JsonTape&&) = default;
+
+            JsonTape& operator=(const JsonTape&) = delete;
+            JsonTape& operator=(JsonTape&&) = delete;
+
+            static JsonTape parse(string_view json) {
+                JsonStructuralIndex index { JsonStructuralIndex::build(json) };
+                JsonTape tape { json, index.positions() };
+                tape.parseValue();
+                if (!tape.done()) {
+                    throw tape.error("Unexpected JSON content: end of file was expected", tape.position());
+                }
+
+                tape._positions = { };
+                tape._scratch = string { };
+                return tape;
+            }
+
+            JsonTapeValue root() const {
+                return JsonTapeValue { _tape, 0 };
+            }
+
+            JsonTapeValue operator[](string_view key) const {
+                return root()[key];
+            }
+
+            size_t size() const {
+                return _tape.size();
+            }
+    };
+}
\ No newline at end of file
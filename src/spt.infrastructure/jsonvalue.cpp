@@ -1,12 +1,14 @@
 export module spt.infrastructure:jsonvalue;
 
 import std;
+import :jsonobject;
 
 namespace spt::infrastructure::text {
-    using std::map;
     using std::monostate;
+    using std::move;
     using std::out_of_range;
     using std::string;
+    using std::string_view;
     using std::variant;
     using std::vector;
 
@@ -17,7 +19,7 @@ namespace spt::infrastructure::text {
             using json_number = double;
             using json_string = string;
             using json_array = vector<JsonValue>;
-            using json_object = map<string, JsonValue>;
+            using json_object = JsonObject<JsonValue>;
 
             JsonValue()
                 : _value{ json_null{} } {
@@ -36,15 +38,15 @@ namespace spt::infrastructure::text {
             }
 
             JsonValue(json_string value)
-                : _value{ value } {
+                : _value{ move(value) } {
             }
 
             JsonValue(json_array value)
-                : _value{ value } {
+                : _value{ move(value) } {
             }
 
             JsonValue(json_object value)
-                : _value{ value } {
+                : _value{ move(value) } {
             }
 
             bool isNull() const{
@@ -101,7 +103,7 @@ namespace spt::infrastructure::text {
                 return result;
             }
 
-            bool contains(const string& key) const {
+            bool contains(string_view key) const {
                 if (!isObject()) {
                     return false;
                 }
@@ -115,7 +117,7 @@ namespace spt::infrastructure::text {
                 return getArray().at(index);
             }
 
-            const JsonValue& operator[](const string& key) const {
+            const JsonValue& operator[](string_view key) const {
                 if (!isObject()) {
                     throw out_of_range{"Indexing operator[] called on non-object JsonValue"};
                 }                    
@@ -127,4 +129,4 @@ namespace spt::infrastructure::text {
         private:
             variant<json_null, json_boolean, json_number, json_string, json_array, json_object> _value;
     };
-}
+}
\ No newline at end of file
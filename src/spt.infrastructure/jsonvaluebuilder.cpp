@@ -0,0 +1,101 @@
+export module spt.infrastructure:jsonvaluebuilder;
+
+import std;
+import :jsonobject;
+import :jsonvalue;
+import :jsonhandler;
+
+namespace spt::infrastructure::text {
+    using std::logic_error;
+    using std::make_shared;
+    using std::move;
+    using std::optional;
+    using std::nullopt;
+    using std::shared_ptr;
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    // Assembles the events of a JsonHandler back into a JsonValue.
+    export class JsonValueBuilder final : public JsonHandler {
+        private:
+            struct Frame {
+                JsonValue::json_array values;
+                vector<string_view> keys;
+            };
+
+            vector<Frame> _frames;
+            optional<JsonValue> _result;
+            shared_ptr<JsonKeyTable> _keys;
+
+            void add(JsonValue value) {
+                if (_frames.empty()) {
+                    _result = move(value);
+                    return;
+                }
+
+                Frame& top { _frames.back() };
+                top.values.push_back(move(value));
+            }
+
+        public:
+            JsonValueBuilder()
+                : _frames { },
+                  _result { nullopt },
+                  _keys { make_shared<JsonKeyTable>() }
+            {
+            }
+
+            bool hasResult() const {
+                return _result.has_value();
+            }
+
+            JsonValue result() {
+                if (!_result.has_value()) {
+                    throw logic_error { "No complete JSON value has been built" };
+                }
+                return move(_result.value());
+            }
+
+            void onNull() override {
+                add(JsonValue { });
+            }
+
+            void onBoolean(bool value) override {
+                add(JsonValue { value });
+            }
+
+            void onNumber(double value) override {
+                add(JsonValue { value });
+            }
+
+            void onString(string_view value) override {
+                add(JsonValue { string { value } });
+            }
+
+            void onKey(string_view key) override {
+                _frames.back().keys.push_back(_keys->intern(key));
+            }
+
+            void onStartObject() override {
+                _frames.push_back(Frame { });
+            }
+
+            void onEndObject() override {
+                Frame& top { _frames.back() };
+                JsonValue::json_object object { _keys, move(top.keys), move(top.values) };
+                _frames.pop_back();
+                add(JsonValue { move(object) });
+            }
+
+            void onStartArray() override {
+                _frames.push_back(Frame { });
+            }
+
+            void onEndArray() override {
+                auto array = move(_frames.back().values);
+                _frames.pop_back();
+                add(JsonValue { move(array) });
+            }
+    };
+}
\ No newline at end of file
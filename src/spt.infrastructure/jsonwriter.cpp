@@ -0,0 +1,276 @@
+export module spt.infrastructure:jsonwriter;
+
+import std;
+import :jsonvalue;
+import :jsonhandler;
+
+namespace spt::infrastructure::text {
+    using std::array;
+    using std::FILE;
+    using std::format;
+    using std::fwrite;
+    using std::function;
+    using std::isfinite;
+    using std::logic_error;
+    using std::move;
+    using std::runtime_error;
+    using std::size_t;
+    using std::string;
+    using std::string_view;
+    using std::to_chars;
+    using std::uint8_t;
+    using std::vector;
+
+    // Serializes JSON into a reusable buffer. Values are written either from a JsonValue or
+    // directly through the JsonHandler events, so a JsonStreamParser can feed a writer and
+    // nothing needs to be materialized. With a sink, the buffer is handed over and reused every
+    // time it grows past the flush threshold.
+    export class JsonWriter final : public JsonHandler {
+        public:
+            using sink_t = function<void(string_view)>;
+
+        private:
+            // 0: copied as is, 1: short escape, 2: \u00XX
+            static constexpr array<uint8_t, 256> escapes { [] {
+                array<uint8_t, 256> table { };
+                for (size_t ch = 0; ch < 0x20; ++ch) {
+                    table[ch] = 2;
+                }
+                table['"'] = 1;
+                table['\\'] = 1;
+                table['\b'] = 1;
+                table['\f'] = 1;
+                table['\n'] = 1;
+                table['\r'] = 1;
+                table['\t'] = 1;
+                return table;
+            }() };
+
+            string _buffer;
+            sink_t _sink;
+            size_t _threshold;
+            vector<char> _containers;
+            bool _first;
+            bool _afterKey;
+
+            void flushIfFull() {
+                if (_sink && _buffer.size() >= _threshold) {
+                    _sink(_buffer);
+                    _buffer.clear();
+                }
+            }
+
+            // Writes the separator that goes before the next key or value.
+            void separate() {
+                if (_afterKey) {
+                    _afterKey = false;
+                    return;
+                }
+                if (!_first) {
+                    _buffer += ',';
+                }
+                _first = false;
+            }
+
+            // Every value inside an object must follow its key. Hands what the previous values
+            // filled over to the sink, so long runs of numbers are streamed like strings.
+            void beginValue() {
+                if (!_containers.empty() && _containers.back() == '{' && !_afterKey) {
+                    throw logic_error { "JsonWriter value written in an object without a key" };
+                }
+                flushIfFull();
+                separate();
+            }
+
+            void open(char ch) {
+                beginValue();
+                _buffer += ch;
+                _containers.push_back(ch);
+                _first = true;
+            }
+
+            void close(char open, char ch) {
+                if (_containers.empty() || _containers.back() != open || _afterKey) {
+                    throw logic_error { format("Unbalanced '{0}' in JsonWriter", ch) };
+                }
+                _containers.pop_back();
+                _buffer += ch;
+                _first = false;
+                flushIfFull();
+            }
+
+            // Copies runs of characters that need no escaping in one append.
+            void appendQuoted(string_view text) {
+                constexpr char hex[] { "0123456789abcdef" };
+
+                _buffer += '"';
+                size_t run { 0 };
+                for (size_t i = 0; i < text.size(); ++i) {
+                    auto ch { static_cast<uint8_t>(text[i]) };
+                    auto kind { escapes[ch] };
+                    if (kind == 0) {
+                        continue;
+                    }
+
+                    _buffer.append(text.substr(run, i - run));
+                    run = i + 1;
+                    if (kind == 1) {
+                        char escaped { ch == '\b' ? 'b' : ch == '\f' ? 'f' : ch == '\n' ? 'n' : ch == '\r' ? 'r' : ch == '\t' ? 't' : static_cast<char>(ch) };
+                        _buffer += '\\';
+                        _buffer += escaped;
+                    } else {
+                        _buffer += "\\u00";
+                        _buffer += hex[ch >> 4];
+                        _buffer += hex[ch & 0xF];
+                    }
+                }
+                _buffer.append(text.substr(run));
+                _buffer += '"';
+            }
+
+        public:
+            static constexpr size_t defaultThreshold { 64 * 1024 };
+
+            JsonWriter()
+                : _buffer { },
+                  _sink { },
+                  _threshold { defaultThreshold },
+                  _containers { },
+                  _first { true },
+                  _afterKey { false }
+            {
+            }
+
+            explicit JsonWriter(sink_t sink, size_t threshold = defaultThreshold)
+                : _buffer { },
+                  _sink { move(sink) },
+                  _threshold { threshold },
+                  _containers { },
+                  _first { true },
+                  _afterKey { false }
+            {
+                _buffer.reserve(threshold + threshold / 4);
+            }
+
+            JsonWriter(const JsonWriter&) = delete;
+            JsonWriter& operator=(const JsonWriter&) = delete;
+
+            // A sink that appends to an open C stream.
+            static sink_t fileSink(FILE* file) {
+                return [file](string_view chunk) {
+                    if (fwrite(chunk.data(), 1, chunk.size(), file) != chunk.size()) {
+                        throw runtime_error { "Failed to write JSON output" };
+                    }
+                };
+            }
+
+            static string serialize(const JsonValue& value) {
+                JsonWriter writer { };
+                writer.write(value);
+                return string { writer.view() };
+            }
+
+            // Output written since the last flush or clear.
+            string_view view() const {
+                return _buffer;
+            }
+
+            // Resets the writer for a new document, keeping the buffer's capacity.
+            void clear() {
+                _buffer.clear();
+                _containers.clear();
+                _first = true;
+                _afterKey = false;
+            }
+
+            void flush() {
+                if (_sink && !_buffer.empty()) {
+                    _sink(_buffer);
+                    _buffer.clear();
+                }
+            }
+
+            void write(const JsonValue& value) {
+                if (value.isNull()) {
+                    onNull();
+                } else if (value.isBoolean()) {
+                    onBoolean(value.getBoolean());
+                } else if (value.isNumber()) {
+                    onNumber(value.getNumber());
+                } else if (value.isString()) {
+                    onString(value.getString());
+                } else if (value.isArray()) {
+                    onStartArray();
+                    for (const auto& element : value.getArray()) {
+                        write(element);
+                    }
+                    onEndArray();
+                } else {
+                    onStartObject();
+                    for (const auto& [key, member] : value.getObject()) {
+                        onKey(key);
+                        write(member);
+                    }
+                    onEndObject();
+                }
+            }
+
+            void onNull() override {
+                beginValue();
+                _buffer += "null";
+            }
+
+            void onBoolean(bool value) override {
+                beginValue();
+                _buffer += value ? "true" : "false";
+            }
+
+            // Shortest representation that reads back to the same double; JSON has no NaN or
+            // infinity, so those are written as null.
+            void onNumber(double value) override {
+                beginValue();
+                if (!isfinite(value)) {
+                    _buffer += "null";
+                    return;
+                }
+                char digits[32];
+                auto result { to_chars(digits, digits + sizeof(digits), value) };
+                _buffer.append(digits, result.ptr);
+            }
+
+            void onString(string_view value) override {
+                beginValue();
+                appendQuoted(value);
+                flushIfFull();
+            }
+
+            void onKey(string_view key) override {
+                if (_containers.empty() || _containers.back() != '{') {
+                    throw logic_error { "JsonWriter key written outside of an object" };
+                }
+                if (_afterKey) {
+                    throw logic_error { "JsonWriter key written where a value was expected" };
+                }
+                separate();
+                appendQuoted(key);
+                _buffer += ':';
+                _afterKey = true;
+            }
+
+            void onStartObject() override {
+                open('{');
+            }
+
+            void onEndObject() override {
+                close('{', '}');
+            }
+
+            void onStartArray() override {
+                open('[');
+            }
+
+            void onEndArray() override {
+                close('[', ']');
+            }
+    };
+}
\ No newline at end of file
@@ -1,34 +1,101 @@
 export module spt.infrastructure:restservice;
 
 import std;
+import :httpcache;
 import :httpclient;
+import :httpeventloop;
+import :httpmetrics;
+import :httpratelimiter;
 import :httprequest;
 import :httpresponse;
+import :httptransfer;
 import :jsonvalue;
-import :jsonparser;
+import :jsondocument;
+import :jsonstreamparser;
+import :jsonvaluebuilder;
+import :singleflight;
 
 namespace spt::infrastructure::services {
+    using std::exception;
     using std::format;
+    using std::future;
+    using std::make_shared;
+    using std::move;
     using std::nullopt;
     using std::optional;
     using std::runtime_error;
+    using std::shared_ptr;
     using std::string;
+    using std::string_view;
+    using std::vector;
+    using spt::infrastructure::net::HttpCache;
+    using spt::infrastructure::net::HttpCancellationToken;
     using spt::infrastructure::net::HttpRequest;
     using spt::infrastructure::net::HttpResponse;
     using spt::infrastructure::net::HttpClient;
     using spt::infrastructure::net::HttpMethod;
-    using spt::infrastructure::text::JsonParser;
+    using spt::infrastructure::net::HttpMetrics;
+    using spt::infrastructure::net::HttpRateLimiter;
+    using spt::infrastructure::net::HttpVersion;
+    using spt::infrastructure::text::JsonDocument;
+    using spt::infrastructure::text::JsonStreamParser;
     using spt::infrastructure::text::JsonValue;
+    using spt::infrastructure::text::JsonValueBuilder;
 
     export class RestService {
         private:
+            // requests in flight, by what they return
+            struct Flights {
+                SingleFlight<JsonDocument> documents;
+                SingleFlight<JsonValue> values;
+            };
+
             string _userAgent;
             string _accept;
+            HttpClient _client;
+            shared_ptr<Flights> _flights;
+
+            // One connection pool, response cache and rate limiter for every REST service, so
+            // they all reuse the same kept-alive connections, multiplexed over HTTP/2 where the
+            // server offers it, repeat lookups are answered locally or with a 304, and together
+            // they stay under the provider's request ceiling, riding out 429s with retries. Its
+            // metrics show where the time of slow refreshes goes.
+            static const HttpClient& sharedClient() {
+                static const HttpClient client { [] {
+                    HttpClient result { };
+                    result.httpVersion(HttpVersion::Http2);
+                    result.cache(make_shared<HttpCache>());
+                    result.rateLimiter(make_shared<HttpRateLimiter>());
+                    result.metrics(make_shared<HttpMetrics>());
+                    return result;
+                }() };
+                return client;
+            }
+
+            // Services on the shared client also share their requests in flight, so a refresh
+            // and a search asking for the same URL at once make one request between them.
+            static const shared_ptr<Flights>& sharedFlights() {
+                static const shared_ptr<Flights> flights { make_shared<Flights>() };
+                return flights;
+            }
+
+            RestService(HttpClient client, shared_ptr<Flights> flights)
+                : _userAgent { "Blendwerk SPT/1.0" },
+                  _accept { "application/json" },
+                  _client { move(client) },
+                  _flights { move(flights) }
+            {
+                _client.timeout(10L);
+            }
 
         public:
             RestService()
-                : _userAgent { "Blendwerk SPT/1.0" },
-                  _accept { "application/json" }
+                : RestService(sharedClient(), sharedFlights())
+            {
+            }
+
+            explicit RestService(HttpClient client)
+                : RestService(move(client), make_shared<Flights>())
             {
             }
 
@@ -42,6 +109,21 @@ namespace spt::infrastructure::services {
 
             virtual ~RestService() = default;            
             
+            const HttpClient& client() const {
+                return _client;
+            }
+
+            // How many fetches were answered by a request another caller already had in flight.
+            SingleFlightStats coalescing() const {
+                auto documents { _flights->documents.stats() };
+                auto values { _flights->values.stats() };
+                return SingleFlightStats {
+                    documents.calls + values.calls,
+                    documents.executions + values.executions,
+                    documents.coalesced + values.coalesced
+                };
+            }
+
         protected:
             void setAccept(const string& accept) {
                 _accept = accept;
@@ -51,27 +133,99 @@ namespace spt::infrastructure::services {
                 _userAgent = userAgent;
             }
 
-            JsonValue fetchData(string url) {
+            HttpRequest requestFor(const string& url) const {
                 HttpRequest request { url, HttpMethod::GET };
                 request.setHeader("Accept", _accept);
                 request.setHeader("User-Agent", _userAgent);
+                return request;
+            }
 
-                HttpClient client { };
-                client.timeout(10L);
-
-                HttpResponse response { client.send(request) };
+            static HttpResponse successful(HttpResponse response) {
                 if (!response.isSuccess()) {
                     throw runtime_error {
                         format("Failed to fetch data from REST Service: status code {0}", response.status())
                     };
                 }
 
-                JsonValue json { JsonParser::parse(response.body()) };                    
-                if (!json.isObject()) {
-                    throw runtime_error { "Invalid response from REST Service." };
+                return response;
+            }
+
+            HttpResponse fetchResponse(string url, HttpClient::body_sink_t sink = nullptr) {
+                return successful(_client.send(requestFor(url), move(sink)));
+            }
+
+            // Queued on the client's event loop, so the requests in flight share its connections,
+            // and HTTP/2 streams, instead of blocking a thread each. Pass the response to
+            // successful() before using it.
+            future<HttpResponse> fetchResponseAsync(const string& url, HttpCancellationToken token = { }) {
+                return _client.sendAsync(requestFor(url), move(token));
+            }
+
+            // The body is parsed chunk by chunk while it downloads and is never buffered whole.
+            // Concurrent calls for the same URL share one request and get a copy of its value.
+            JsonValue fetchData(string url) {
+                return _flights->values.run(_accept + ' ' + url, [this, &url] {
+                    JsonValueBuilder builder { };
+                    JsonStreamParser parser { builder };
+                    fetchResponse(url, [&parser](string_view chunk) {
+                        parser.feed(chunk);
+                    });
+                    parser.finish();
+
+                    JsonValue json { builder.result() };
+                    if (!json.isObject()) {
+                        throw runtime_error { "Invalid response from REST Service." };
+                    }
+
+                    return json;
+                });
+            }
+
+            // Parses the body where it was downloaded; the document keeps the response, and with
+            // it the pooled buffer, alive for as long as it is used.
+            static JsonDocument documentOf(HttpResponse response) {
+                auto owner { make_shared<const HttpResponse>(move(response)) };
+                return JsonDocument { owner->body(), owner };
+            }
+
+            // Sends every request at once and parses the responses in the order of 'urls'. A
+            // document is nullopt where its request failed or did not return a JSON object, for
+            // callers that can fall back to other requests for the data it would have held.
+            vector<optional<JsonDocument>> fetchDocuments(const vector<string>& urls) {
+                vector<HttpRequest> requests { };
+                for (const auto& url : urls) {
+                    requests.push_back(requestFor(url));
+                }
+
+                vector<optional<JsonDocument>> documents { };
+                for (auto& pending : _client.sendAll(requests)) {
+                    try {
+                        HttpResponse response { pending.get() };
+                        if (response.isSuccess()) {
+                            JsonDocument document { documentOf(move(response)) };
+                            if (document.root().isObject()) {
+                                documents.push_back(move(document));
+                                continue;
+                            }
+                        }
+                    } catch (const exception&) {
+                        // left to the fallback
+                    }
+                    documents.push_back(nullopt);
                 }
+                return documents;
+            }
+
+            // Concurrent calls for the same URL share one request, and the parsed document.
+            JsonDocument fetchDocument(string url) {
+                return _flights->documents.run(_accept + ' ' + url, [this, &url] {
+                    JsonDocument document { documentOf(fetchResponse(url)) };
+                    if (!document.root().isObject()) {
+                        throw runtime_error { "Invalid response from REST Service." };
+                    }
 
-                return json;
+                    return document;
+                });
             }
     };
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+export module spt.infrastructure:singleflight;
+
+import std;
+
+namespace spt::infrastructure::services {
+    using std::current_exception;
+    using std::function;
+    using std::lock_guard;
+    using std::mutex;
+    using std::promise;
+    using std::shared_future;
+    using std::size_t;
+    using std::string;
+    using std::unordered_map;
+
+    export struct SingleFlightStats {
+        size_t calls;
+        size_t executions;
+        size_t coalesced;   // calls that waited for an execution already in flight
+    };
+
+    // Runs one piece of work per key at a time: a call made while the same key is in flight
+    // waits for that execution and gets a copy of its result, or the exception it threw,
+    // instead of doing the work again. Nothing is kept once the execution completes, so a call
+    // arriving afterwards starts a new one.
+    export template <typename T>
+    class SingleFlight final {
+        private:
+            mutable mutex _mutex;
+            unordered_map<string, shared_future<T>> _inflight;
+            SingleFlightStats _stats;
+
+        public:
+            SingleFlight()
+                : _mutex { },
+                  _inflight { },
+                  _stats { }
+            {
+            }
+
+            SingleFlight(const SingleFlight&) = delete;
+            SingleFlight& operator=(const SingleFlight&) = delete;
+
+            SingleFlightStats stats() const {
+                lock_guard<mutex> lock { _mutex };
+                return _stats;
+            }
+
+            T run(const string& key, const function<T()>& work) {
+                promise<T> execution { };
+                shared_future<T> result { };
+                bool executes { false };
+                {
+                    // looked up and registered under one lock, so only one caller per key executes
+                    lock_guard<mutex> lock { _mutex };
+                    ++_stats.calls;
+                    auto inflight { _inflight.find(key) };
+                    if (inflight != _inflight.end()) {
+                        ++_stats.coalesced;
+                        result = inflight->second;
+                    } else {
+                        ++_stats.executions;
+                        result = execution.get_future().share();
+                        _inflight.emplace(key, result);
+                        executes = true;
+                    }
+                }
+                if (!executes) {
+                    return result.get();
+                }
+                try {
+                    execution.set_value(work());
+                } catch (...) {
+                    execution.set_exception(current_exception());
+                }
+                {
+                    lock_guard<mutex> lock { _mutex };
+                    _inflight.erase(key);
+                }
+                return result.get();
+            }
+    };
+}
\ No newline at end of file
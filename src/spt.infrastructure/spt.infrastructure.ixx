@@ -2,9 +2,18 @@ export module spt.infrastructure;
 
 // net infrastructure
 export import :httpheaders;
+export import :httprecording;
 export import :httprequest;
+export import :httpbuffer;
 export import :httpresponse;
+export import :httpcache;
+export import :httpconnectionpool;
+export import :httpratelimiter;
+export import :httpmetrics;
+export import :httptransfer;
+export import :httpeventloop;
 export import :httpclient;
+export import :httpreplayserver;
 // sql infrastructure
 export import :value;
 export import :row;
@@ -12,11 +21,25 @@ export import :resultset;
 export import :statement;
 export import :database;
 // text infrastructure
+export import :jsonobject;
 export import :jsonvalue;
+export import :jsonstructuralindex;
+export import :jsonnumberarray;
+export import :jsonscalars;
+export import :jsonstructuralparser;
+export import :jsondocument;
+export import :jsonbinder;
+export import :jsontape;
+export import :jsonhandler;
+export import :jsonvaluebuilder;
+export import :jsonstreamparser;
 export import :jsonparser;
+export import :jsonwriter;
 // repositories infrastructure
 export import :repository;
 // rest services infrastructure
+export import :singleflight;
+export import :boundedqueue;
 export import :restservice;
 export import :yahoocompanysearch;
-export import :yahoopricefetcher;
+export import :yahoopricefetcher;
\ No newline at end of file
@@ -5,8 +5,8 @@ import spt.domain;
 import :httpclient;
 import :httprequest;
 import :httpresponse;
-import :jsonvalue;
-import :jsonparser;
+import :jsonbinder;
+import :jsondocument;
 import :restservice;
 
 namespace spt::infrastructure::services {
@@ -27,14 +27,53 @@ namespace spt::infrastructure::services {
     using spt::infrastructure::net::HttpResponse;
     using spt::infrastructure::net::HttpClient;
     using spt::infrastructure::net::HttpMethod;
-    using spt::infrastructure::text::JsonParser;
-    using spt::infrastructure::text::JsonValue;
+    using spt::infrastructure::text::JsonBinder;
+    using spt::infrastructure::text::JsonDocument;
+    using spt::infrastructure::text::JsonField;
     using spt::infrastructure::services::RestService;
 
+    // The descriptive fields of a quote in the search response. Only the first quote is
+    // decoded; the others, news, lists and scores are skipped.
+    struct YahooSearchQuote {
+        optional<string> symbol;
+        optional<string> shortname;
+        optional<string> quoteType;
+        optional<string> exchDisp;
+        optional<string> sectorDisp;
+        optional<string> industryDisp;
+    };
+}
+
+namespace spt::infrastructure::text {
+    using std::tuple;
+    using spt::infrastructure::services::YahooSearchQuote;
+
+    template <>
+    struct JsonBinding<YahooSearchQuote> {
+        static constexpr auto fields = tuple {
+            JsonField { "symbol", &YahooSearchQuote::symbol },
+            JsonField { "shortname", &YahooSearchQuote::shortname },
+            JsonField { "quoteType", &YahooSearchQuote::quoteType },
+            JsonField { "exchDisp", &YahooSearchQuote::exchDisp },
+            JsonField { "sectorDisp", &YahooSearchQuote::sectorDisp },
+            JsonField { "industryDisp", &YahooSearchQuote::industryDisp }
+        };
+    };
+}
+
+namespace spt::infrastructure::services {
     export class YahooCompanySearch final : public RestService, public CompanySearch {
         private:
             string _url;
 
+            // A field the search result must have, as it had to before the response was bound.
+            static string required(const optional<string>& value, string_view name) {
+                if (!value.has_value()) {
+                    throw runtime_error { format("Search result has no '{0}'", name) };
+                }
+                return *value;
+            }
+
         public:
             YahooCompanySearch()
                 : RestService(),
@@ -42,6 +81,13 @@ namespace spt::infrastructure::services {
             {
             }
 
+            // Sends through 'client' instead of the client shared by every service.
+            explicit YahooCompanySearch(HttpClient client)
+                : RestService(move(client)),
+                  _url { "https://query1.finance.yahoo.com/v1/finance/search" }
+            {
+            }
+
             optional<Company> search(Ticker ticker) override {
                 return search(ticker.symbol());
             }
@@ -53,21 +99,19 @@ namespace spt::infrastructure::services {
                     format("{0}?q={1}", _url, name)
                 };
 
-                JsonValue json { fetchData(url) };
-                const auto& quotes = json["quotes"].getArray();
-                if (!quotes.empty()) {
-                    const auto& quote = quotes[0];
-                    if (quote.isObject()) {                            
-                        Ticker ticker { quote["symbol"].getString() };
-                        Company company { move(ticker) };
-                        company.setName(quote["shortname"].getString());
-                        company.setType(quote["quoteType"].getString());
-                        company.setExchange(quote["exchDisp"].getString());
-                        company.setSector(quote["sectorDisp"].getString());
-                        company.setIndustry(quote["industryDisp"].getString());
-                        
-                        result = move(company);
-                    }
+                JsonDocument document { fetchDocument(url) };
+                auto quotes { document["quotes"] };
+                if (quotes.count() > 0 && quotes[0].isObject()) {
+                    auto quote { JsonBinder::decode<YahooSearchQuote>(quotes[0]) };
+                    Ticker ticker { required(quote.symbol, "symbol") };
+                    Company company { move(ticker) };
+                    company.setName(required(quote.shortname, "shortname"));
+                    company.setType(required(quote.quoteType, "quoteType"));
+                    company.setExchange(required(quote.exchDisp, "exchDisp"));
+                    company.setSector(required(quote.sectorDisp, "sectorDisp"));
+                    company.setIndustry(required(quote.industryDisp, "industryDisp"));
+
+                    result = move(company);
                 }
 
                 return result;
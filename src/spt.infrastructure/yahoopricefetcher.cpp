@@ -2,20 +2,57 @@ export module spt.infrastructure:yahoopricefetcher;
 
 import std;
 import spt.domain;
+import :boundedqueue;
 import :httpclient;
+import :httpeventloop;
+import :httpmetrics;
 import :httprequest;
 import :httpresponse;
-import :jsonvalue;
-import :jsonparser;
+import :jsonbinder;
+import :jsondocument;
+import :jsonnumberarray;
 import :restservice;
 
 namespace spt::infrastructure::services {
+    using std::chrono::days;
+    using std::chrono::duration_cast;
+    using std::chrono::hours;
+    using std::chrono::microseconds;
+    using std::chrono::minutes;
+    using std::chrono::months;
     using std::chrono::seconds;
+    using std::chrono::steady_clock;
     using std::chrono::system_clock;
+    using std::chrono::weeks;
+    using std::chrono::years;
+    using std::atomic;
+    using std::current_exception;
+    using std::deque;
+    using std::errc;
+    using std::exception;
+    using std::exception_ptr;
     using std::format;
-    using std::get;
-    using std::make_tuple;
+    using std::future;
+    using std::from_chars;
+    using std::invalid_argument;
+    using std::isnan;
+    using std::jthread;
+    using std::lock_guard;
+    using std::make_shared;
+    using std::max;
+    using std::move;
+    using std::mutex;
+    using std::nullopt;
+    using std::optional;
+    using std::rethrow_exception;
+    using std::runtime_error;
+    using std::size_t;
     using std::string;
+    using std::string_view;
+    using std::uint64_t;
+    using std::unordered_map;
+    using std::unordered_set;
+    using std::vector;
     using std::views::filter;
     using std::views::transform;
     using std::views::zip;
@@ -24,21 +61,789 @@ namespace spt::infrastructure::services {
     using spt::domain::investments::PriceFetcher;
     using spt::domain::investments::Price;
     using spt::domain::investments::Money;
-    using spt::infrastructure::text::JsonValue;
+    using spt::domain::investments::Ticker;
+    using spt::infrastructure::net::HttpCancellationToken;
+    using spt::infrastructure::net::HttpClient;
+    using spt::infrastructure::net::HttpHistogram;
+    using spt::infrastructure::net::HttpResponse;
+    using spt::infrastructure::text::JsonBinder;
+    using spt::infrastructure::text::JsonDocument;
+    using spt::infrastructure::text::JsonField;
+    using spt::infrastructure::text::JsonNumberArray;
     using spt::infrastructure::services::RestService;
 
+    // The parts of the chart response that are used, everything else is skipped while binding.
+    struct YahooChartQuote {
+        JsonNumberArray close;
+    };
+
+    struct YahooChartIndicators {
+        vector<YahooChartQuote> quote;
+    };
+
+    struct YahooChartResult {
+        JsonNumberArray timestamp;
+        YahooChartIndicators indicators;
+    };
+
+    struct YahooChart {
+        vector<YahooChartResult> result;
+    };
+
+    struct YahooChartResponse {
+        YahooChart chart;
+    };
+
+    // The spark endpoint answers with a chart result for each of the symbols asked for.
+    struct YahooSparkResult {
+        string symbol;
+        vector<YahooChartResult> response;
+    };
+
+    struct YahooSpark {
+        vector<YahooSparkResult> result;
+    };
+
+    struct YahooSparkResponse {
+        YahooSpark spark;
+    };
+
+    struct YahooQuote {
+        string symbol;
+        optional<double> regularMarketPrice;
+        optional<double> regularMarketTime;
+    };
+
+    struct YahooQuotes {
+        vector<YahooQuote> result;
+    };
+
+    struct YahooQuoteResponse {
+        YahooQuotes quoteResponse;
+    };
+}
+
+namespace spt::infrastructure::text {
+    using std::tuple;
+    using spt::infrastructure::services::YahooChartQuote;
+    using spt::infrastructure::services::YahooChartIndicators;
+    using spt::infrastructure::services::YahooChartResult;
+    using spt::infrastructure::services::YahooChart;
+    using spt::infrastructure::services::YahooChartResponse;
+    using spt::infrastructure::services::YahooSparkResult;
+    using spt::infrastructure::services::YahooSpark;
+    using spt::infrastructure::services::YahooSparkResponse;
+    using spt::infrastructure::services::YahooQuote;
+    using spt::infrastructure::services::YahooQuotes;
+    using spt::infrastructure::services::YahooQuoteResponse;
+
+    template <>
+    struct JsonBinding<YahooChartQuote> {
+        static constexpr auto fields = tuple {
+            JsonField { "close", &YahooChartQuote::close }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooChartIndicators> {
+        static constexpr auto fields = tuple {
+            JsonField { "quote", &YahooChartIndicators::quote }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooChartResult> {
+        static constexpr auto fields = tuple {
+            JsonField { "timestamp", &YahooChartResult::timestamp },
+            JsonField { "indicators", &YahooChartResult::indicators }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooChart> {
+        static constexpr auto fields = tuple {
+            JsonField { "result", &YahooChart::result }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooChartResponse> {
+        static constexpr auto fields = tuple {
+            JsonField { "chart", &YahooChartResponse::chart }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooSparkResult> {
+        static constexpr auto fields = tuple {
+            JsonField { "symbol", &YahooSparkResult::symbol },
+            JsonField { "response", &YahooSparkResult::response }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooSpark> {
+        static constexpr auto fields = tuple {
+            JsonField { "result", &YahooSpark::result }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooSparkResponse> {
+        static constexpr auto fields = tuple {
+            JsonField { "spark", &YahooSparkResponse::spark }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooQuote> {
+        static constexpr auto fields = tuple {
+            JsonField { "symbol", &YahooQuote::symbol },
+            JsonField { "regularMarketPrice", &YahooQuote::regularMarketPrice },
+            JsonField { "regularMarketTime", &YahooQuote::regularMarketTime }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooQuotes> {
+        static constexpr auto fields = tuple {
+            JsonField { "result", &YahooQuotes::result }
+        };
+    };
+
+    template <>
+    struct JsonBinding<YahooQuoteResponse> {
+        static constexpr auto fields = tuple {
+            JsonField { "quoteResponse", &YahooQuoteResponse::quoteResponse }
+        };
+    };
+}
+
+namespace spt::infrastructure::services {
+    // Threads and queue sizes of the pipeline a portfolio is fetched through.
+    export struct FetchPipelineOptions {
+        size_t fetchers;        // requests in flight at once
+        size_t parsers;
+        size_t appliers;        // companies updated at once, each by a single thread
+        size_t queueCapacity;   // companies waiting between two stages before the earlier one stalls
+    };
+
+    export struct FetchStageStats {
+        size_t items;
+        microseconds busy;      // summed over the stage's threads, or over its requests for the fetchers
+        size_t stalls;          // hand-overs that waited for room in the next stage's queue
+    };
+
+    export struct FetchPipelineStats {
+        size_t companies;
+        microseconds elapsed;
+        // from a company entering the pipeline, waiting for room included, to its prices updated
+        microseconds p50;
+        microseconds p99;
+        microseconds max;
+        FetchStageStats fetch;
+        FetchStageStats parse;
+        FetchStageStats apply;
+    };
+
+    // Fetching a portfolio with a few requests for many symbols each instead of one per symbol.
+    export struct FetchBatchOptions {
+        bool enabled;
+        size_t sparkSymbols;    // intraday series per spark request; Yahoo answers at most 20
+        size_t quoteSymbols;    // current quotes per quote request, 0 to skip quotes
+    };
+
+    export struct FetchBatchStats {
+        size_t requests;
+        size_t charted;         // companies updated from a spark response
+        size_t deltas;          // companies updated from a chart request starting at their latest price
+        size_t quoted;          // companies given their current quote
+        size_t fallbacks;       // companies missing from the batches and fetched one by one
+    };
+
+    // Companies charted since the fetcher was created: over the whole range, on their own or in
+    // a spark batch, and deltas asking only for the points after a company's latest price.
+    export struct FetchDeltaStats {
+        size_t full;
+        size_t incremental;
+        size_t bytes;           // response bodies of both, and of quote batches
+        size_t bytesSaved;      // estimated against the last whole range fetched for the symbol
+    };
+
+    export enum class FetchOutcome {
+        Success,    // new prices were applied
+        Skipped,    // the response held nothing newer than the prices already known
+        Error
+    };
+
+    export struct FetchResult {
+        Ticker ticker;
+        FetchOutcome outcome;
+        size_t points;          // new prices applied
+        microseconds latency;   // from its request being sent to its prices applied, or the failure
+        string error;
+    };
+
+    export struct FetchReport {
+        vector<FetchResult> results;    // in the order of the portfolio's tickers
+        microseconds elapsed;
+        size_t succeeded;
+        size_t skipped;
+        size_t failed;
+    };
+
     export class YahooPriceFetcher final : public RestService, public PriceFetcher {
         private:
+            struct ChartPoint {
+                system_clock::time_point timestamp;
+                double price;
+            };
+
+            // A company on its way through the pipeline.
+            struct Job {
+                Company* company;
+                FetchResult* result;    // nullptr when a failure stops the pipeline
+                optional<system_clock::time_point> since;
+                steady_clock::time_point queued;
+                steady_clock::time_point started;
+                future<HttpResponse> pending;
+                optional<HttpResponse> response;
+                vector<ChartPoint> points;
+            };
+
+            struct StageCounters {
+                atomic<size_t> items;
+                atomic<microseconds::rep> busy;
+            };
+
             string _url;
+            string _sparkUrl;
+            string _quoteUrl;
             string _interval;
             string _range;
+            FetchPipelineOptions _pipeline;
+            FetchPipelineStats _pipelineStats;
+            FetchBatchOptions _batching;
+            FetchBatchStats _batchStats;
+            bool _incremental;
+            mutable mutex _deltaMutex;
+            unordered_map<string, size_t> _fullBytes;
+            FetchDeltaStats _deltaStats;
+
+            // How far back a range such as "5d" or "3mo" reaches, or how long an interval such as
+            // "1m" or "1h" is; nullopt for "ytd", "max" and the like.
+            static optional<system_clock::duration> durationOf(string_view range) {
+                int count { 0 };
+                auto [unit, error] { from_chars(range.data(), range.data() + range.size(), count) };
+                if (error != errc { } || count <= 0) {
+                    return nullopt;
+                }
+                string_view suffix { unit, static_cast<size_t>(range.data() + range.size() - unit) };
+                if (suffix == "m") {
+                    return minutes { count };
+                } else if (suffix == "h") {
+                    return hours { count };
+                } else if (suffix == "d") {
+                    return days { count };
+                } else if (suffix == "wk") {
+                    return weeks { count };
+                } else if (suffix == "mo") {
+                    return months { count };
+                } else if (suffix == "y") {
+                    return years { count };
+                }
+                return nullopt;
+            }
+
+            // Where a delta for 'company' starts: its latest price, so that point comes back as well
+            // and is revised if its period was still open. nullopt when the whole range is needed,
+            // because there are no prices yet or the latest fell out of the range.
+            optional<system_clock::time_point> deltaStart(const Company& company) const {
+                if (!_incremental) {
+                    return nullopt;
+                }
+                auto latest { company.latestPriceTimestamp() };
+                auto range { durationOf(_range) };
+                if (latest == system_clock::time_point { } || !range || latest < system_clock::now() - *range) {
+                    return nullopt;
+                }
+                return latest;
+            }
+
+            // The end of a delta, now rounded up to the next interval boundary: the URL stays the
+            // same for a whole interval, so the cache and concurrent callers can share it, and it
+            // still covers the period that is open now.
+            system_clock::time_point deltaEnd() const {
+                auto now { system_clock::now() };
+                auto step { durationOf(_interval) };
+                if (!step || *step <= system_clock::duration::zero()) {
+                    return now;
+                }
+                auto elapsed { now.time_since_epoch() };
+                return system_clock::time_point { (elapsed + *step - system_clock::duration { 1 }) / *step * *step };
+            }
+
+            string chartUrl(const Company& company, optional<system_clock::time_point> since) const {
+                if (since) {
+                    return format("{0}/{1}?period1={2}&period2={3}&interval={4}",
+                        _url,
+                        company.ticker().symbol(),
+                        system_clock::to_time_t(*since),
+                        system_clock::to_time_t(deltaEnd()),
+                        _interval
+                    );
+                }
+                return format("{0}/{1}?range={2}&interval={3}",
+                    _url, 
+                    company.ticker().symbol(),
+                    _range,
+                    _interval
+                );
+            }
+
+            // Bodies that are no one company's chart, such as quote batches.
+            void account(size_t bytes) {
+                lock_guard<mutex> lock { _deltaMutex };
+                _deltaStats.bytes += bytes;
+            }
+
+            // Called from the pipeline's fetchers as well, hence the lock. A company charted in a
+            // spark batch is counted with its share of the batch's body.
+            void account(const Company& company, bool incremental, size_t bytes) {
+                lock_guard<mutex> lock { _deltaMutex };
+                _deltaStats.bytes += bytes;
+                if (!incremental) {
+                    ++_deltaStats.full;
+                    _fullBytes[company.ticker().symbol()] = bytes;
+                    return;
+                }
+                ++_deltaStats.incremental;
+                auto full { _fullBytes.find(company.ticker().symbol()) };
+                if (full != _fullBytes.end() && full->second > bytes) {
+                    _deltaStats.bytesSaved += full->second - bytes;
+                }
+            }
+
+            static vector<ChartPoint> pointsOf(const JsonDocument& document, const Ticker& ticker) {
+                auto response { JsonBinder::decode<YahooChartResponse>(document) };
+                auto& results { response.chart.result };
+                if (results.empty() || results[0].indicators.quote.empty()) {
+                    throw runtime_error {
+                        format("No chart data returned for {0}", ticker.symbol())
+                    };
+                }
+                return pointsOf(results[0]);
+            }
+
+            // Empty where the result holds no quotes.
+            static vector<ChartPoint> pointsOf(const YahooChartResult& result) {
+                if (result.indicators.quote.empty()) {
+                    return { };
+                }
+                const JsonNumberArray& timestamps { result.timestamp };
+                const JsonNumberArray& prices { result.indicators.quote[0].close };
+
+                auto points = zip(timestamps.values(), prices.values())
+                    | filter([](const auto& pair) {
+                        const auto& [ts, price] = pair;
+                        return !isnan(ts) && !isnan(price); // nulls are stored as NaN
+                    })
+                    | transform([](const auto& pair) {
+                        const auto& [ts, price] = pair;
+                        return ChartPoint { system_clock::from_time_t(static_cast<time_t>(ts)), price };
+                    });
+                return vector<ChartPoint> { points.begin(), points.end() };
+            }
+
+            // Returns how many new prices were added.
+            static size_t apply(Company& company, const vector<ChartPoint>& points) {
+                size_t added { 0 };
+                auto latestTimestamp = company.latestPriceTimestamp();
+                for (const auto& point : points) {
+                    if (point.timestamp > latestTimestamp) { // only new timestamps
+                        company.updatePrice(point.timestamp, Price { Money { point.price } });
+                        ++added;
+                    } else if (point.timestamp == latestTimestamp && latestTimestamp != system_clock::time_point { }) {
+                        company.reviseLatestPrice(Price { Money { point.price } });
+                    }
+                }
+                return added;
+            }
+
+            static void settle(FetchResult& result, size_t added, steady_clock::time_point started) {
+                result.outcome = added > 0 || result.outcome == FetchOutcome::Success ? FetchOutcome::Success : FetchOutcome::Skipped;
+                result.points += added;
+                result.latency = duration_cast<microseconds>(steady_clock::now() - started);
+            }
+
+            static string messageOf(exception_ptr error) {
+                try {
+                    rethrow_exception(error);
+                } catch (const exception& e) {
+                    return e.what();
+                } catch (...) {
+                    return "Unknown error";
+                }
+            }
+
+            // Fetches, parses and applies concurrently, the stages connected by bounded queues, so
+            // the network, the parser and the domain work at the same time and a slow stage
+            // holds the others back instead of letting work pile up in memory. Requests run on
+            // the client's event loop, up to getPipeline().fetchers at a time, and the parsers
+            // and appliers on threads of their own. Without 'results' the first error stops the
+            // pipeline and is rethrown once every thread has finished; with them, parallel to
+            // 'companies', each error is reported for its own company only.
+            void runPipeline(const vector<Company*>& companies, const vector<FetchResult*>& results) {
+                auto started { steady_clock::now() };
+                FetchPipelineOptions options { _pipeline };
+                BoundedQueue<Job> toParse { options.queueCapacity };
+                BoundedQueue<Job> toApply { options.queueCapacity };
+                StageCounters fetching { };
+                StageCounters parsing { };
+                StageCounters applying { };
+                HttpHistogram latency { };
+                HttpCancellationToken cancellation { };
+                mutex failure { };
+                exception_ptr error { nullptr };
+
+                // returns whether the stage can go on with its next job
+                auto fail = [&](Job& job, exception_ptr exception) {
+                    if (job.result != nullptr) {
+                        settle(*job.result, 0, job.started);
+                        job.result->outcome = FetchOutcome::Error;
+                        job.result->error = messageOf(exception);
+                        return true;
+                    }
+                    {
+                        lock_guard<mutex> lock { failure };
+                        if (error == nullptr) {
+                            error = exception;
+                        }
+                    }
+                    cancellation.cancel();
+                    toParse.abort();
+                    toApply.abort();
+                    return false;
+                };
+
+                // 'count' threads run 'work' on each job from 'input' and pass it on to
+                // 'output', which the last of them to finish closes.
+                auto stage = [&fail](size_t count, BoundedQueue<Job>& input, BoundedQueue<Job>* output, StageCounters& counters, auto work) {
+                    auto running { make_shared<atomic<size_t>>(count) };
+                    vector<jthread> threads { };
+                    for (size_t i = 0; i < count; ++i) {
+                        threads.emplace_back([&fail, &input, output, &counters, running, work] {
+                            while (auto job = input.pop()) {
+                                auto begun { steady_clock::now() };
+                                try {
+                                    work(*job);
+                                } catch (...) {
+                                    if (fail(*job, current_exception())) {
+                                        continue;
+                                    }
+                                    break;
+                                }
+                                counters.busy += duration_cast<microseconds>(steady_clock::now() - begun).count();
+                                ++counters.items;
+                                if (output != nullptr && !output->push(move(*job))) {
+                                    break;
+                                }
+                            }
+                            if (--*running == 0 && output != nullptr) {
+                                output->close();
+                            }
+                        });
+                    }
+                    return threads;
+                };
+
+                // declared after what they use, so the threads are joined before it is destroyed
+                auto appliers { stage(options.appliers, toApply, nullptr, applying, [&latency](Job& job) {
+                    size_t added { apply(*job.company, job.points) };
+                    if (job.result != nullptr) {
+                        settle(*job.result, added, job.started);
+                    }
+                    latency.record(static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now() - job.queued).count()));
+                }) };
+                auto parsers { stage(options.parsers, toParse, &toApply, parsing, [](Job& job) {
+                    JsonDocument document { documentOf(move(*job.response)) };
+                    job.response.reset();
+                    job.points = pointsOf(document, job.company->ticker());
+                }) };
+
+                // declared after the threads, so however this function is left the parsers run
+                // out of work, and the appliers after them, before the threads are joined
+                struct QueueCloser {
+                    BoundedQueue<Job>& queue;
+
+                    ~QueueCloser() {
+                        queue.close();
+                    }
+                };
+                QueueCloser closer { toParse };
+
+                // Waits for the oldest request and hands its response to the parsers; returns
+                // whether the pipeline goes on. The others keep running on the event loop meanwhile.
+                deque<Job> inFlight { };
+                auto receive = [&] {
+                    Job job { move(inFlight.front()) };
+                    inFlight.pop_front();
+                    try {
+                        job.response = successful(job.pending.get());
+                        account(*job.company, job.since.has_value(), job.response->body().size());
+                        fetching.busy += job.response->timings().total.count();
+                        ++fetching.items;
+                    } catch (...) {
+                        return fail(job, current_exception());
+                    }
+                    return toParse.push(move(job));
+                };
+
+                bool going { true };
+                for (size_t i = 0; i < companies.size() && going; ++i) {
+                    while (inFlight.size() >= options.fetchers && going) {
+                        going = receive();
+                    }
+                    if (!going) {
+                        break;
+                    }
+                    auto now { steady_clock::now() };
+                    Job job { companies[i], results.empty() ? nullptr : results[i], deltaStart(*companies[i]), now, now, { }, nullopt, { } };
+                    job.pending = fetchResponseAsync(chartUrl(*job.company, job.since), cancellation);
+                    inFlight.push_back(move(job));
+                }
+                while (!inFlight.empty() && going) {
+                    going = receive();
+                }
+                if (!going) {
+                    cancellation.cancel();
+                }
+                toParse.close();
+                parsers.clear();
+                appliers.clear();
+
+                auto statsOf = [](const StageCounters& counters, size_t stalls) {
+                    return FetchStageStats { counters.items.load(), microseconds { counters.busy.load() }, stalls };
+                };
+                _pipelineStats = FetchPipelineStats {
+                    companies.size(),
+                    duration_cast<microseconds>(steady_clock::now() - started),
+                    microseconds { latency.percentile(50.0) },
+                    microseconds { latency.percentile(99.0) },
+                    microseconds { latency.max() },
+                    statsOf(fetching, toParse.stalls()),
+                    statsOf(parsing, toApply.stalls()),
+                    statsOf(applying, 0)
+                };
+                if (error != nullptr) {
+                    rethrow_exception(error);
+                }
+            }
+
+            // Splits 'symbols' into the fewest chunks of at most 'limit' symbols, all about the
+            // same size so the last request is not left with a handful of them.
+            static vector<string> chunksOf(const vector<string>& symbols, size_t limit) {
+                vector<string> chunks { };
+                if (symbols.empty()) {
+                    return chunks;
+                }
+                size_t count { (symbols.size() + limit - 1) / limit };
+                size_t size { symbols.size() / count };
+                size_t larger { symbols.size() % count };   // chunks taking one symbol more
+                auto symbol { symbols.begin() };
+                for (size_t i = 0; i < count; ++i) {
+                    string chunk { };
+                    for (size_t j = 0; j < size + (i < larger ? 1 : 0); ++j, ++symbol) {
+                        if (!chunk.empty()) {
+                            chunk += ',';
+                        }
+                        chunk += *symbol;
+                    }
+                    chunks.push_back(move(chunk));
+                }
+                return chunks;
+            }
+
+            // Asks the spark endpoint for the series and the quote endpoint for the current price
+            // of many symbols per request. Companies with a delta to fetch get a chart request
+            // each from their latest price on instead, sent along with the batches so all run at
+            // once on the event loop. Those left without prices go through the pipeline one
+            // chart request each. 'results' works as for runPipeline().
+            void fetchBatched(const vector<Company*>& companies, const vector<FetchResult*>& results) {
+                auto started { steady_clock::now() };
+                FetchBatchOptions options { _batching };
+                unordered_map<Company*, FetchResult*> resultOf { };
+                for (size_t i = 0; i < results.size(); ++i) {
+                    resultOf.emplace(companies[i], results[i]);
+                }
+                unordered_map<string, Company*> bySymbol { };
+                vector<string> symbols { };
+                vector<string> wholeSymbols { };
+                vector<Company*> deltaCompanies { };
+                vector<string> deltaUrls { };
+                for (Company* company : companies) {
+                    string symbol { company->ticker().symbol() };
+                    if (!bySymbol.emplace(symbol, company).second) {
+                        continue;
+                    }
+                    if (auto since { deltaStart(*company) }) {
+                        deltaCompanies.push_back(company);
+                        deltaUrls.push_back(chartUrl(*company, since));
+                    } else {
+                        wholeSymbols.push_back(symbol);
+                    }
+                    symbols.push_back(move(symbol));
+                }
+
+                vector<string> urls { };
+                for (const auto& chunk : chunksOf(wholeSymbols, options.sparkSymbols)) {
+                    urls.push_back(format("{0}?symbols={1}&range={2}&interval={3}", _sparkUrl, chunk, _range, _interval));
+                }
+                size_t sparks { urls.size() };
+                urls.insert(urls.end(), deltaUrls.begin(), deltaUrls.end());
+                size_t charts { urls.size() };
+                if (options.quoteSymbols > 0) {
+                    for (const auto& chunk : chunksOf(symbols, options.quoteSymbols)) {
+                        urls.push_back(format("{0}?symbols={1}", _quoteUrl, chunk));
+                    }
+                }
+                auto documents { fetchDocuments(urls) };
+
+                unordered_set<Company*> charted { };
+                for (size_t i = 0; i < sparks; ++i) {
+                    if (!documents[i]) {
+                        continue;
+                    }
+                    size_t bytes { documents[i]->json().size() };
+                    try {
+                        auto spark { JsonBinder::decode<YahooSparkResponse>(*documents[i]).spark };
+                        size_t share { bytes / max<size_t>(spark.result.size(), 1) };
+                        for (const auto& result : spark.result) {
+                            auto found { bySymbol.find(result.symbol) };
+                            if (found != bySymbol.end()) {
+                                account(*found->second, false, share);
+                                bytes -= share;
+                            }
+                        }
+                        for (const auto& result : spark.result) {
+                            auto found { bySymbol.find(result.symbol) };
+                            if (found == bySymbol.end() || result.response.empty()) {
+                                continue;
+                            }
+                            auto points { pointsOf(result.response[0]) };
+                            if (!points.empty()) {
+                                size_t added { apply(*found->second, points) };
+                                charted.insert(found->second);
+                                if (auto reported { resultOf.find(found->second) }; reported != resultOf.end()) {
+                                    settle(*reported->second, added, started);
+                                }
+                            }
+                        }
+                    } catch (const exception&) {
+                        // whatever was not applied is fetched one by one below
+                    }
+                    account(bytes);     // what no symbol of the batch was charged for
+                }
+
+                size_t deltas { 0 };
+                for (size_t i = sparks; i < charts; ++i) {
+                    Company* company { deltaCompanies[i - sparks] };
+                    if (!documents[i]) {
+                        continue;
+                    }
+                    account(*company, true, documents[i]->json().size());
+                    try {
+                        size_t added { apply(*company, pointsOf(*documents[i], company->ticker())) };
+                        charted.insert(company);
+                        ++deltas;
+                        if (auto reported { resultOf.find(company) }; reported != resultOf.end()) {
+                            settle(*reported->second, added, started);
+                        }
+                    } catch (const exception&) {
+                        // fetched again through the pipeline below
+                    }
+                }
+
+                vector<Company*> remaining { };
+                vector<FetchResult*> remainingResults { };
+                for (size_t i = 0; i < companies.size(); ++i) {
+                    if (!charted.contains(companies[i])) {
+                        remaining.push_back(companies[i]);
+                        if (!results.empty()) {
+                            remainingResults.push_back(results[i]);
+                        }
+                    }
+                }
+                _batchStats = FetchBatchStats { urls.size(), charted.size() - deltas, deltas, 0, remaining.size() };
+                if (!remaining.empty()) {
+                    runPipeline(remaining, remainingResults);
+                }
+
+                // applied last, as a price newer than a series would keep that series out
+                for (size_t i = charts; i < documents.size(); ++i) {
+                    if (!documents[i]) {
+                        continue;
+                    }
+                    account(documents[i]->json().size());
+                    try {
+                        for (const auto& quote : JsonBinder::decode<YahooQuoteResponse>(*documents[i]).quoteResponse.result) {
+                            auto found { bySymbol.find(quote.symbol) };
+                            if (found == bySymbol.end() || !quote.regularMarketPrice || !quote.regularMarketTime
+                                || isnan(*quote.regularMarketPrice) || isnan(*quote.regularMarketTime)) {
+                                continue;
+                            }
+                            size_t added { apply(*found->second, { ChartPoint {
+                                system_clock::from_time_t(static_cast<time_t>(*quote.regularMarketTime)),
+                                *quote.regularMarketPrice
+                            } }) };
+                            ++_batchStats.quoted;
+                            auto reported { resultOf.find(found->second) };
+                            if (added > 0 && reported != resultOf.end() && reported->second->outcome != FetchOutcome::Error) {
+                                reported->second->outcome = FetchOutcome::Success;
+                                reported->second->points += added;
+                            }
+                        }
+                    } catch (const exception&) {
+                        // the series fetched above already hold a recent price
+                    }
+                }
+            }
 
         public:        
             YahooPriceFetcher()
                 : RestService(),
                   _url { "https://query1.finance.yahoo.com/v8/finance/chart" },
+                  _sparkUrl { "https://query1.finance.yahoo.com/v8/finance/spark" },
+                  _quoteUrl { "https://query1.finance.yahoo.com/v7/finance/quote" },
                   _interval { "1m" },
-                  _range { "1d" }
+                  _range { "1d" },
+                  _pipeline { 8, 2, 1, 16 },
+                  _pipelineStats { },
+                  _batching { false, 20, 50 },
+                  _batchStats { },
+                  _incremental { true },
+                  _deltaMutex { },
+                  _fullBytes { },
+                  _deltaStats { }
+            {
+            }
+
+            // Sends through 'client' instead of the client shared by every service.
+            explicit YahooPriceFetcher(HttpClient client)
+                : RestService(move(client)),
+                  _url { "https://query1.finance.yahoo.com/v8/finance/chart" },
+                  _sparkUrl { "https://query1.finance.yahoo.com/v8/finance/spark" },
+                  _quoteUrl { "https://query1.finance.yahoo.com/v7/finance/quote" },
+                  _interval { "1m" },
+                  _range { "1d" },
+                  _pipeline { 8, 2, 1, 16 },
+                  _pipelineStats { },
+                  _batching { false, 20, 50 },
+                  _batchStats { },
+                  _incremental { true },
+                  _deltaMutex { },
+                  _fullBytes { },
+                  _deltaStats { }
             {
             }
 
@@ -58,47 +863,110 @@ namespace spt::infrastructure::services {
                 _range = range;
             }
 
+            FetchPipelineOptions getPipeline() const {
+                return _pipeline;
+            }
+
+            void setPipeline(FetchPipelineOptions pipeline) {
+                if (pipeline.fetchers == 0 || pipeline.parsers == 0 || pipeline.appliers == 0 || pipeline.queueCapacity == 0) {
+                    throw invalid_argument { "Every pipeline stage needs a thread and room to queue" };
+                }
+                _pipeline = pipeline;
+            }
+
+            // Of the last portfolio fetched.
+            FetchPipelineStats getPipelineStats() const {
+                return _pipelineStats;
+            }
+
+            FetchBatchOptions getBatching() const {
+                return _batching;
+            }
+
+            void setBatching(FetchBatchOptions batching) {
+                if (batching.sparkSymbols == 0) {
+                    throw invalid_argument { "A spark request needs room for at least one symbol" };
+                }
+                _batching = batching;
+            }
+
+            // Of the last portfolio fetched with batching enabled.
+            FetchBatchStats getBatchStats() const {
+                return _batchStats;
+            }
+
+            bool getIncremental() const {
+                return _incremental;
+            }
+
+            // Whether companies with recent prices are fetched from their latest price on instead
+            // of over the whole range.
+            void setIncremental(bool incremental) {
+                _incremental = incremental;
+            }
+
+            FetchDeltaStats getDeltaStats() const {
+                lock_guard<mutex> lock { _deltaMutex };
+                return _deltaStats;
+            }
+
             void fetch(Portfolio& portfolio) override {
+                vector<Company*> companies { };
                 for (auto& ticker : portfolio.tickers()) {
-                    Company& company { portfolio.getCompany(ticker) };
-                    fetch(company);
+                    companies.push_back(&portfolio.getCompany(ticker));
+                }
+                if (_batching.enabled) {
+                    fetchBatched(companies, { });
+                } else {
+                    runPipeline(companies, { });
                 }
             }
 
-            void fetch(Company& company) override {
-                string url { 
-                    format("{0}/{1}?range={2}&interval={3}",
-                        _url, 
-                        company.ticker().symbol(),
-                        _range,
-                        _interval
-                    )
-                };
+            // Like fetch(Portfolio&), getPipeline().fetchers requests at a time as far as the
+            // client's maxConnectionsPerHost() allows, but a company that fails is reported and
+            // the others still get their prices, so this only throws where the portfolio itself
+            // cannot be read.
+            FetchReport fetchAll(Portfolio& portfolio) {
+                auto started { steady_clock::now() };
+                vector<Company*> companies { };
+                FetchReport report { { }, microseconds { 0 }, 0, 0, 0 };
+                for (auto& ticker : portfolio.tickers()) {
+                    companies.push_back(&portfolio.getCompany(ticker));
+                    report.results.push_back(FetchResult { ticker, FetchOutcome::Skipped, 0, microseconds { 0 }, { } });
+                }
+                vector<FetchResult*> results { };
+                for (auto& result : report.results) {
+                    results.push_back(&result);
+                }
 
-                JsonValue json { fetchData(url) };
-                const auto& result = json["chart"]["result"][0];
-                const auto& timestamps = result["timestamp"].getArray();
-                const auto& prices = result["indicators"]["quote"][0]["close"].getArray();
-                
-                auto latestTimestamp = company.latestPriceTimestamp();
-                
-                auto priceData = zip(timestamps, prices)
-                    | filter([](const auto& pair) {
-                        const auto& [ts, price] = pair;
-                        return ts.isNumber() && price.isNumber();
-                    })
-                    | transform([&latestTimestamp](const auto& pair) {
-                        const auto& [ts, price] = pair;
-                        auto timestamp = system_clock::from_time_t(static_cast<time_t>(ts.getNumber()));
-                        return make_tuple(timestamp, price.getNumber(), timestamp > latestTimestamp);
-                    })
-                    | filter([](const auto& tuple) {
-                        return get<2>(tuple); // only new timestamps
-                    });
-                
-                for (const auto& [timestamp, priceValue, _] : priceData) {
-                    company.updatePrice(timestamp, Price { Money { priceValue } });
+                if (_batching.enabled) {
+                    fetchBatched(companies, results);
+                } else {
+                    runPipeline(companies, results);
                 }
+
+                for (const auto& result : report.results) {
+                    switch (result.outcome) {
+                        case FetchOutcome::Success:
+                            ++report.succeeded;
+                            break;
+                        case FetchOutcome::Skipped:
+                            ++report.skipped;
+                            break;
+                        case FetchOutcome::Error:
+                            ++report.failed;
+                            break;
+                    }
+                }
+                report.elapsed = duration_cast<microseconds>(steady_clock::now() - started);
+                return report;
+            }
+
+            void fetch(Company& company) override {
+                auto since { deltaStart(company) };
+                auto document { fetchDocument(chartUrl(company, since)) };
+                account(company, since.has_value(), document.json().size());
+                apply(company, pointsOf(document, company.ticker()));
             }
     };
-}
+}
\ No newline at end of file